@@ -0,0 +1,128 @@
+#!/bin/bash
+# NOTE(hugo): Reproducible benchmark. Renders every Cornell box variant
+# and the teapot headless with a fixed seed and sample count, once
+# with full paths and once with camera rays only, and gathers the load
+# time, build time, Mrays/s (total and primary) and memory of each
+# scene in build/bench.json.
+#
+# Each image is compared to its reference in data/bench : the script
+# fails if the RMSE of any of them is above the tolerance. The
+# references are (re)written with --update-reference, to be done
+# after checking the new images when a change is meant to alter them.
+#
+# The renderer has no refraction, only diffuse and specular blends :
+# the references are exact for every scene but CornellBox-Water, at an
+# RMSE of about 0.007. The camera and bounce directions come from
+# NormalizedFast (rsqrt and one Newton step, times the vector), a few
+# ulps off the division by the length the references were made with,
+# and on that scene it is enough to send some paths elsewhere (still
+# 0.004 with an exact 1 / sqrt). Keep the tolerance above it.
+#
+# ./bench.sh [--update-reference] [--tolerance 0.01] [--key value]...
+# Any other argument is forwarded to every run, e.g. --threads 8.
+# Changing the resolution or the passes needs new references.
+
+CODE_PATH="$(dirname "$0")"
+BUILD_PATH="$CODE_PATH/../build"
+REFERENCE_PATH="../data/bench"
+
+UpdateReference=0
+Tolerance=0.01
+ForwardedArguments=()
+while [ $# -gt 0 ]
+do
+	case "$1" in
+		--update-reference) UpdateReference=1; shift;;
+		--tolerance) Tolerance="$2"; shift 2;;
+		*) ForwardedArguments+=("$1"); shift;;
+	esac
+done
+
+BenchArguments=(--headless --seed 1234 --width 128 --height 128 --passes 8 --samples-per-task 1)
+
+pushd "$BUILD_PATH" > /dev/null
+mkdir -p "$REFERENCE_PATH"
+
+Failed=0
+First=1
+{
+	echo "{"
+	echo "  \"tolerance\": $Tolerance,"
+	echo "  \"scenes\": ["
+} > bench.json
+
+for Scene in ../data/CornellBox/CornellBox-*.obj ../data/teapot_with_normal.obj
+do
+	Name="$(basename "$Scene" .obj)"
+	Reference="$REFERENCE_PATH/$Name.pfm"
+
+	Full=$(./ray-x86_64 "${BenchArguments[@]}" --scene "$Scene" --output "bench_$Name" \
+		--reference "$Reference" "${ForwardedArguments[@]}" | grep "^Summary:")
+	Primary=$(./ray-x86_64 "${BenchArguments[@]}" --scene "$Scene" --output "bench_primary_$Name" \
+		--primary-only on "${ForwardedArguments[@]}" | grep "^Summary:")
+	if [ -z "$Full" ] || [ -z "$Primary" ]
+	then
+		echo "$Name : the render failed."
+		Failed=1
+		continue
+	fi
+
+	Line=$(printf "%s\n%s\n" "$Full" "$Primary" | awk -v Name="$Name" -v Tolerance="$Tolerance" '
+	{
+		for(i = 1; i <= NF; ++i)
+		{
+			split($i, KeyValue, "=");
+			Value[NR, KeyValue[1]] = KeyValue[2];
+		}
+	}
+	END {
+		RMSE = Value[1, "rmse"];
+		Status = "ok";
+		if(RMSE < 0)
+		{
+			Status = "no reference";
+		}
+		else if(RMSE > Tolerance)
+		{
+			Status = "FAILED";
+		}
+		printf("%s|%s|{\"scene\": \"%s\", \"load_ms\": %s, \"build_ms\": %s, \"total_mrays_per_s\": %s, " \
+			"\"primary_mrays_per_s\": %s, \"arena_mb\": %s, \"committed_mb\": %s, \"peak_rss_mb\": %s, \"rmse\": %s}|" \
+			"%-36s load %8sms  build %8sms  total %7s Mrays/s  primary %7s Mrays/s  arena %7sMB  rmse %s\n",
+			Status, RMSE, Name, Value[1, "load_ms"], Value[1, "build_ms"], Value[1, "Mrays/s"],
+			Value[2, "Mrays/s"], Value[1, "arena_mb"], Value[1, "committed_mb"], Value[1, "peak_rss_mb"], RMSE,
+			Name, Value[1, "load_ms"], Value[1, "build_ms"], Value[1, "Mrays/s"],
+			Value[2, "Mrays/s"], Value[1, "arena_mb"], RMSE);
+	}')
+	IFS="|" read -r Status RMSE Json Report <<< "$Line"
+
+	if [ $First -eq 0 ]
+	then
+		echo "," >> bench.json
+	fi
+	First=0
+	printf "    %s" "$Json" >> bench.json
+
+	echo "$Report ($Status)"
+	if [ $UpdateReference -eq 1 ]
+	then
+		cp "bench_$Name.pfm" "$Reference"
+	elif [ "$Status" = "FAILED" ]
+	then
+		Failed=1
+	fi
+done
+
+{
+	echo ""
+	echo "  ]"
+	echo "}"
+} >> bench.json
+
+popd > /dev/null
+echo "Results written to $BUILD_PATH/bench.json"
+if [ $UpdateReference -eq 1 ]
+then
+	echo "References written to $BUILD_PATH/$REFERENCE_PATH"
+fi
+exit $Failed
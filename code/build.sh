@@ -26,6 +26,9 @@ pushd "$CODE_PATH/../build"
 
 $CXX $CommonFlags -O3 ../code/ray.cpp $CommonLinkerFlags -o ray-x86_64
 #$CXX $CommonFlags ../code/ray.cpp $CommonLinkerFlags -o ray-x86_64
+#$CXX $CommonFlags -O3 -DRAY_TRAVERSAL_STATS=1 ../code/ray.cpp $CommonLinkerFlags -o ray-stats-x86_64
+#$CXX $CommonFlags -O3 -DRAY_PROFILE=0 ../code/ray.cpp $CommonLinkerFlags -o ray-noprofile-x86_64
+#$CXX $CommonFlags -O3 -mavx ../code/ray.cpp $CommonLinkerFlags -o ray-avx-x86_64
 
 popd
 
@@ -0,0 +1,732 @@
+#pragma once
+
+// NOTE(hugo): Every render setting that used to be a compile-time
+// constant. The config is filled once at startup, first from the
+// defaults, then from an optional config file (--config), and finally
+// from the command line so that a script can override single values.
+//
+// The config file has one "key = value" per line, '#' starts a comment.
+// The command line uses the same keys : --key value.
+
+#define CONFIG_PATH_SIZE 512
+
+enum integrator_mode
+{
+	// NOTE(hugo): One full path at a time per pixel, in tiles.
+	Integrator_Path,
+	// NOTE(hugo): Batches of paths through separate stages (wavefront.cpp).
+	Integrator_Wavefront,
+};
+
+enum tree_builder
+{
+	// NOTE(hugo): Midpoint kd-tree (kdtree.cpp), built recursively
+	// on the main thread.
+	TreeBuilder_KdTree,
+	// NOTE(hugo): Morton code BVH (lbvh.cpp), a few linear passes on
+	// the worker pool. Which of the two traces faster depends on the
+	// scene : neither uses a cost model to place its splits.
+	TreeBuilder_LBVH,
+};
+
+global_variable char* TreeBuilderNames[] =
+{
+	"kd-tree", "LBVH",
+};
+
+struct render_config
+{
+	u32 Width;
+	u32 Height;
+	u32 ChunkWidth;
+	u32 ChunkHeight;
+	// NOTE(hugo): If set, ChunkWidth/Height are only the starting
+	// tile size, then adjusted from the measured cost of each tile.
+	bool AutoTileSize;
+	tile_order TileOrder;
+
+	// NOTE(hugo): 0 means the default pass count of the mode.
+	u32 PassCount;
+	// NOTE(hugo): Samples per pixel rendered by a tile task in one pass.
+	u32 SamplesPerTask;
+	integrator_mode Integrator;
+	// NOTE(hugo): Camera rays are traced in packets of PacketSize x PacketSize
+	// (4 or 8), 0 tracing them one by one. Path integrator only.
+	u32 PacketSize;
+	// NOTE(hugo): Only trace camera rays, to measure their throughput.
+	bool PrimaryOnly;
+	// NOTE(hugo): Paths traced together by the wavefront integrator.
+	u32 WavefrontBatchSize;
+	// NOTE(hugo): Sort the bounced rays of a wavefront batch by
+	// origin cell and direction octant before tracing them.
+	bool SortRays;
+	// NOTE(hugo): Count hardware cache misses (Linux perf events).
+	bool CountCacheMisses;
+	// NOTE(hugo): Print the timed blocks every this many passes, 0 never.
+	u32 ProfileInterval;
+	// NOTE(hugo): Transparent huge pages for the scene geometry and tree.
+	bool HugePages;
+	// NOTE(hugo): Memory the arenas may commit before the warning,
+	// in megabytes. 0 means the physical memory of the machine.
+	u32 MemoryBudgetMB;
+	tree_builder TreeBuilder;
+	// NOTE(hugo): Length of the Morton codes of the LBVH, 30 or 63.
+	u32 MortonBits;
+	// NOTE(hugo): A refitted tree is rebuilt once its SAH cost is
+	// more than this many times the one right after its build.
+	float RefitRebuildRatio;
+	// NOTE(hugo): 0 means one worker per logical CPU, minus the main thread.
+	u32 ThreadCount;
+	thread_pinning Pinning;
+	// NOTE(hugo): When not 0, only run the scheduler benchmark
+	// with this many tasks per round.
+	u32 QueueBenchmarkTaskCount;
+	// NOTE(hugo): When not 0, only run the resolve benchmark
+	// with this many iterations per mode.
+	u32 ResolveBenchmarkIterations;
+	// NOTE(hugo): When not 0, only run the normalize benchmark
+	// with this many iterations per precision.
+	u32 NormalizeBenchmarkIterations;
+	// NOTE(hugo): When not 0, only rebuild the tree of the scene
+	// this many times.
+	u32 BuildBenchmarkIterations;
+	// NOTE(hugo): When not 0, only deform the scene and refit
+	// its tree for this many frames.
+	u32 RefitBenchmarkFrames;
+	u64 Seed;
+
+	tonemap_operator Tonemap;
+
+	bool Headless;
+	char ScenePath[CONFIG_PATH_SIZE];
+	char MaterialPath[CONFIG_PATH_SIZE];
+	char OutputPath[CONFIG_PATH_SIZE];
+	// NOTE(hugo): Chrome trace of the work queue, empty for no trace.
+	char TracePath[CONFIG_PATH_SIZE];
+	// NOTE(hugo): PFM the headless output is compared to, empty for none.
+	char ReferencePath[CONFIG_PATH_SIZE];
+
+	v3 CameraP;
+	v3 CameraXAxis;
+	v3 CameraZAxis;
+	float FoVDegrees;
+	float FocalLength;
+};
+
+internal render_config
+DefaultRenderConfig(void)
+{
+	render_config Config = {};
+	Config.Width = 512;
+	Config.Height = 512;
+	Config.ChunkWidth = 64;
+	Config.ChunkHeight = 64;
+	Config.AutoTileSize = false;
+	Config.TileOrder = TileOrder_Default;
+	Config.PassCount = 0;
+	Config.SamplesPerTask = 1;
+	Config.Integrator = Integrator_Path;
+	Config.PacketSize = 0;
+	Config.PrimaryOnly = false;
+	Config.WavefrontBatchSize = 1 << 16;
+	Config.SortRays = true;
+	Config.CountCacheMisses = false;
+	Config.ProfileInterval = 0;
+	Config.HugePages = false;
+	Config.TreeBuilder = TreeBuilder_KdTree;
+	Config.MortonBits = 30;
+	Config.RefitRebuildRatio = 1.5f;
+	Config.ThreadCount = 0;
+	Config.Pinning = ThreadPinning_None;
+	Config.Seed = 1234;
+	Config.Tonemap = Tonemap_None;
+	Config.Headless = false;
+	strcpy(Config.ScenePath, "../data/CornellBox/CornellBox-Original-WithNormals.obj");
+	Config.MaterialPath[0] = '\0';
+	strcpy(Config.OutputPath, "render");
+	Config.TracePath[0] = '\0';
+	Config.ReferencePath[0] = '\0';
+	Config.CameraP = V3(0.0f, 1.0f, 2.5f);
+	Config.CameraXAxis = V3(1.0f, 0.0f, 0.0f);
+	Config.CameraZAxis = V3(0.0f, 0.0f, 1.0f);
+	Config.FoVDegrees = 75.0f;
+	Config.FocalLength = 2.0f;
+	return(Config);
+}
+
+internal bool
+ParseU32(char* Value, u32* Result)
+{
+	char* End = 0;
+	unsigned long Parsed = strtoul(Value, &End, 10);
+	bool Valid = (End != Value) && (*End == '\0');
+	if(Valid)
+	{
+		*Result = (u32)Parsed;
+	}
+	return(Valid);
+}
+
+internal bool
+ParseU64(char* Value, u64* Result)
+{
+	char* End = 0;
+	unsigned long long Parsed = strtoull(Value, &End, 10);
+	bool Valid = (End != Value) && (*End == '\0');
+	if(Valid)
+	{
+		*Result = (u64)Parsed;
+	}
+	return(Valid);
+}
+
+internal bool
+ParseFloat(char* Value, float* Result)
+{
+	char* End = 0;
+	float Parsed = strtof(Value, &End);
+	bool Valid = (End != Value) && (*End == '\0');
+	if(Valid)
+	{
+		*Result = Parsed;
+	}
+	return(Valid);
+}
+
+internal bool
+ParseV3(char* Value, v3* Result)
+{
+	v3 Parsed = {};
+	char Trailing = 0;
+	bool Valid = (sscanf(Value, "%f,%f,%f%c", &Parsed.x, &Parsed.y, &Parsed.z, &Trailing) == 3);
+	if(Valid)
+	{
+		*Result = Parsed;
+	}
+	return(Valid);
+}
+
+internal bool
+ParseBool(char* Value, bool* Result)
+{
+	bool Valid = true;
+	if(StringMatch(Value, "1") || StringMatch(Value, "true") || StringMatch(Value, "on"))
+	{
+		*Result = true;
+	}
+	else if(StringMatch(Value, "0") || StringMatch(Value, "false") || StringMatch(Value, "off"))
+	{
+		*Result = false;
+	}
+	else
+	{
+		Valid = false;
+	}
+	return(Valid);
+}
+
+internal bool
+ParsePath(char* Value, char* Result)
+{
+	bool Valid = (StringLength(Value) < CONFIG_PATH_SIZE);
+	if(Valid)
+	{
+		strcpy(Result, Value);
+	}
+	return(Valid);
+}
+
+internal bool
+SetConfigValue(render_config* Config, char* Key, char* Value)
+{
+	bool Valid = false;
+	if(StringMatch(Key, "width"))
+	{
+		Valid = ParseU32(Value, &Config->Width);
+	}
+	else if(StringMatch(Key, "height"))
+	{
+		Valid = ParseU32(Value, &Config->Height);
+	}
+	else if(StringMatch(Key, "tile-width"))
+	{
+		Valid = ParseU32(Value, &Config->ChunkWidth);
+	}
+	else if(StringMatch(Key, "tile-height"))
+	{
+		Valid = ParseU32(Value, &Config->ChunkHeight);
+	}
+	else if(StringMatch(Key, "auto-tile"))
+	{
+		Valid = ParseBool(Value, &Config->AutoTileSize);
+	}
+	else if(StringMatch(Key, "tile-order"))
+	{
+		Valid = true;
+		if(StringMatch(Value, "row"))
+		{
+			Config->TileOrder = TileOrder_Row;
+		}
+		else if(StringMatch(Value, "morton"))
+		{
+			Config->TileOrder = TileOrder_Morton;
+		}
+		else if(StringMatch(Value, "hilbert"))
+		{
+			Config->TileOrder = TileOrder_Hilbert;
+		}
+		else if(StringMatch(Value, "centre-out"))
+		{
+			Config->TileOrder = TileOrder_CentreOut;
+		}
+		else
+		{
+			Valid = false;
+		}
+	}
+	else if(StringMatch(Key, "passes"))
+	{
+		Valid = ParseU32(Value, &Config->PassCount);
+	}
+	else if(StringMatch(Key, "samples-per-task"))
+	{
+		Valid = ParseU32(Value, &Config->SamplesPerTask);
+	}
+	else if(StringMatch(Key, "integrator"))
+	{
+		Valid = true;
+		if(StringMatch(Value, "path"))
+		{
+			Config->Integrator = Integrator_Path;
+		}
+		else if(StringMatch(Value, "wavefront"))
+		{
+			Config->Integrator = Integrator_Wavefront;
+		}
+		else
+		{
+			Valid = false;
+		}
+	}
+	else if(StringMatch(Key, "builder"))
+	{
+		Valid = true;
+		if(StringMatch(Value, "kd"))
+		{
+			Config->TreeBuilder = TreeBuilder_KdTree;
+		}
+		else if(StringMatch(Value, "lbvh"))
+		{
+			Config->TreeBuilder = TreeBuilder_LBVH;
+		}
+		else
+		{
+			Valid = false;
+		}
+	}
+	else if(StringMatch(Key, "morton-bits"))
+	{
+		Valid = ParseU32(Value, &Config->MortonBits) &&
+			(Config->MortonBits == 30 || Config->MortonBits == 63);
+	}
+	else if(StringMatch(Key, "refit-rebuild"))
+	{
+		Valid = ParseFloat(Value, &Config->RefitRebuildRatio) && (Config->RefitRebuildRatio >= 1.0f);
+	}
+	else if(StringMatch(Key, "sort-rays"))
+	{
+		Valid = ParseBool(Value, &Config->SortRays);
+	}
+	else if(StringMatch(Key, "cache-misses"))
+	{
+		Valid = ParseBool(Value, &Config->CountCacheMisses);
+	}
+	else if(StringMatch(Key, "profile-every"))
+	{
+		Valid = ParseU32(Value, &Config->ProfileInterval);
+	}
+	else if(StringMatch(Key, "packet-size"))
+	{
+		Valid = ParseU32(Value, &Config->PacketSize) &&
+			((Config->PacketSize == 0) || (Config->PacketSize == 4) || (Config->PacketSize == 8));
+	}
+	else if(StringMatch(Key, "primary-only"))
+	{
+		Valid = ParseBool(Value, &Config->PrimaryOnly);
+	}
+	else if(StringMatch(Key, "wavefront-batch"))
+	{
+		Valid = ParseU32(Value, &Config->WavefrontBatchSize);
+	}
+	else if(StringMatch(Key, "threads"))
+	{
+		Valid = ParseU32(Value, &Config->ThreadCount);
+	}
+	else if(StringMatch(Key, "pinning"))
+	{
+		Valid = true;
+		if(StringMatch(Value, "none"))
+		{
+			Config->Pinning = ThreadPinning_None;
+		}
+		else if(StringMatch(Value, "spread"))
+		{
+			Config->Pinning = ThreadPinning_Spread;
+		}
+		else if(StringMatch(Value, "compact"))
+		{
+			Config->Pinning = ThreadPinning_Compact;
+		}
+		else
+		{
+			Valid = false;
+		}
+	}
+	else if(StringMatch(Key, "queue-bench"))
+	{
+		Valid = ParseU32(Value, &Config->QueueBenchmarkTaskCount);
+	}
+	else if(StringMatch(Key, "resolve-bench"))
+	{
+		Valid = ParseU32(Value, &Config->ResolveBenchmarkIterations);
+	}
+	else if(StringMatch(Key, "normalize-bench"))
+	{
+		Valid = ParseU32(Value, &Config->NormalizeBenchmarkIterations);
+	}
+	else if(StringMatch(Key, "build-bench"))
+	{
+		Valid = ParseU32(Value, &Config->BuildBenchmarkIterations);
+	}
+	else if(StringMatch(Key, "refit-bench"))
+	{
+		Valid = ParseU32(Value, &Config->RefitBenchmarkFrames);
+	}
+	else if(StringMatch(Key, "tonemap"))
+	{
+		Valid = true;
+		if(StringMatch(Value, "none"))
+		{
+			Config->Tonemap = Tonemap_None;
+		}
+		else if(StringMatch(Value, "reinhard"))
+		{
+			Config->Tonemap = Tonemap_Reinhard;
+		}
+		else if(StringMatch(Value, "aces"))
+		{
+			Config->Tonemap = Tonemap_ACES;
+		}
+		else
+		{
+			Valid = false;
+		}
+	}
+	else if(StringMatch(Key, "seed"))
+	{
+		Valid = ParseU64(Value, &Config->Seed);
+	}
+	else if(StringMatch(Key, "huge-pages"))
+	{
+		Valid = ParseBool(Value, &Config->HugePages);
+	}
+	else if(StringMatch(Key, "memory-budget"))
+	{
+		Valid = ParseU32(Value, &Config->MemoryBudgetMB);
+	}
+	else if(StringMatch(Key, "headless"))
+	{
+		Valid = ParseBool(Value, &Config->Headless);
+	}
+	else if(StringMatch(Key, "scene"))
+	{
+		Valid = ParsePath(Value, Config->ScenePath);
+	}
+	else if(StringMatch(Key, "mtl-dir"))
+	{
+		Valid = ParsePath(Value, Config->MaterialPath);
+	}
+	else if(StringMatch(Key, "output"))
+	{
+		Valid = ParsePath(Value, Config->OutputPath);
+	}
+	else if(StringMatch(Key, "trace"))
+	{
+		Valid = ParsePath(Value, Config->TracePath);
+	}
+	else if(StringMatch(Key, "reference"))
+	{
+		Valid = ParsePath(Value, Config->ReferencePath);
+	}
+	else if(StringMatch(Key, "camera-pos"))
+	{
+		Valid = ParseV3(Value, &Config->CameraP);
+	}
+	else if(StringMatch(Key, "camera-x"))
+	{
+		Valid = ParseV3(Value, &Config->CameraXAxis);
+	}
+	else if(StringMatch(Key, "camera-z"))
+	{
+		Valid = ParseV3(Value, &Config->CameraZAxis);
+	}
+	else if(StringMatch(Key, "fov"))
+	{
+		Valid = ParseFloat(Value, &Config->FoVDegrees);
+	}
+	else if(StringMatch(Key, "focal"))
+	{
+		Valid = ParseFloat(Value, &Config->FocalLength);
+	}
+	else
+	{
+		printf("Unknown setting '%s'.\n", Key);
+		return(false);
+	}
+
+	if(!Valid)
+	{
+		printf("Invalid value '%s' for setting '%s'.\n", Value, Key);
+	}
+	return(Valid);
+}
+
+internal char*
+TrimWhitespace(char* Str)
+{
+	while(*Str == ' ' || *Str == '\t')
+	{
+		++Str;
+	}
+	char* End = Str + StringLength(Str);
+	while(End > Str && (End[-1] == ' ' || End[-1] == '\t' || End[-1] == '\r' || End[-1] == '\n'))
+	{
+		--End;
+	}
+	*End = '\0';
+	return(Str);
+}
+
+internal bool
+LoadConfigFile(render_config* Config, char* Filename)
+{
+	FILE* ConfigFile = fopen(Filename, "r");
+	if(!ConfigFile)
+	{
+		printf("Could not open config file %s.\n", Filename);
+		return(false);
+	}
+
+	bool Valid = true;
+	char Line[2 * CONFIG_PATH_SIZE];
+	u32 LineNumber = 0;
+	while(Valid && fgets(Line, sizeof(Line), ConfigFile))
+	{
+		++LineNumber;
+		char* Comment = strchr(Line, '#');
+		if(Comment)
+		{
+			*Comment = '\0';
+		}
+
+		char* Key = TrimWhitespace(Line);
+		if(StringEmpty(Key))
+		{
+			continue;
+		}
+
+		char* Separator = strchr(Key, '=');
+		if(!Separator)
+		{
+			printf("%s:%u: expected 'key = value'.\n", Filename, LineNumber);
+			Valid = false;
+		}
+		else
+		{
+			*Separator = '\0';
+			Valid = SetConfigValue(Config, TrimWhitespace(Key), TrimWhitespace(Separator + 1));
+		}
+	}
+
+	fclose(ConfigFile);
+	return(Valid);
+}
+
+internal void
+PrintUsage(char* ProgramName)
+{
+	printf("Usage: %s [--config file] [--headless] [--key value]...\n"
+			"Keys (also usable as 'key = value' in a config file):\n"
+			"  width, height          resolution in pixels\n"
+			"  tile-width, tile-height  size of a render task in pixels\n"
+			"  auto-tile              tune the tile size from measured cost (on/off)\n"
+			"  tile-order             row, morton, hilbert or centre-out\n"
+			"                         (default : centre-out with a window, hilbert headless)\n"
+			"  passes                 number of passes (0 : mode default)\n"
+			"  samples-per-task       samples per pixel a tile renders in a pass\n"
+			"  integrator             path (one path at a time, in tiles)\n"
+			"                         or wavefront (batches of paths by stage)\n"
+			"  wavefront-batch        paths traced together in wavefront mode\n"
+			"  sort-rays              sort bounced rays by origin and direction\n"
+			"                         in wavefront mode (on/off)\n"
+			"  cache-misses           report cache misses per secondary ray\n"
+			"                         in wavefront mode (on/off, Linux only)\n"
+			"  profile-every          print the timed blocks every this many\n"
+			"                         passes (0 : never)\n"
+			"  packet-size            trace camera rays in 4x4 or 8x8 packets (0 : off)\n"
+			"  primary-only           only trace camera rays (on/off)\n"
+			"  huge-pages             transparent huge pages for the scene\n"
+			"                         geometry and tree (on/off, Linux only)\n"
+			"  memory-budget          megabytes the arenas may commit before\n"
+			"                         a warning (0 : physical memory)\n"
+			"  builder                kd (midpoint kd-tree, serial build) or\n"
+			"                         lbvh (linear BVH, parallel build)\n"
+			"  morton-bits            30 or 63, Morton code length of the LBVH\n"
+			"  refit-rebuild          rebuild a refitted tree once its SAH cost\n"
+			"                         is this many times the one of its build\n"
+			"  threads                worker thread count (0 : one per CPU)\n"
+			"  pinning                none, spread (physical cores first)\n"
+			"                         or compact (SMT siblings first)\n"
+			"  queue-bench            run the scheduler benchmark with this\n"
+			"                         many tasks per round, then exit\n"
+			"  resolve-bench          time the resolve stage over this many\n"
+			"                         iterations, then exit\n"
+			"  normalize-bench        time and check the precision of each\n"
+			"                         Normalized over this many iterations,\n"
+			"                         then exit\n"
+			"  build-bench            rebuild the tree of the scene this many\n"
+			"                         times, then exit\n"
+			"  refit-bench            twist the scene and refit its tree for\n"
+			"                         this many frames, then exit\n"
+			"  tonemap                none (clamp), reinhard or aces\n"
+			"  seed                   random seed\n"
+			"  headless               render without a window (on/off)\n"
+			"  scene, mtl-dir         .obj file and its material folder\n"
+			"  output                 headless output path, without extension\n"
+			"  trace                  write a Chrome trace of the tasks to this file\n"
+			"  reference              .pfm to compare the headless output to (RMSE)\n"
+			"  camera-pos, camera-x, camera-z  camera frame as x,y,z\n"
+			"  fov, focal             field of view (degrees) and focal length\n",
+			ProgramName);
+}
+
+internal bool
+ParseCommandLine(render_config* Config, s32 ArgumentCount, char** Arguments)
+{
+	// NOTE(hugo): The config file is loaded first whatever its position
+	// so that the other arguments always override it.
+	for(s32 ArgumentIndex = 1; ArgumentIndex < ArgumentCount; ++ArgumentIndex)
+	{
+		if(StringMatch(Arguments[ArgumentIndex], "--config"))
+		{
+			if(ArgumentIndex + 1 >= ArgumentCount ||
+					!LoadConfigFile(Config, Arguments[ArgumentIndex + 1]))
+			{
+				return(false);
+			}
+		}
+	}
+
+	for(s32 ArgumentIndex = 1; ArgumentIndex < ArgumentCount; ++ArgumentIndex)
+	{
+		char* Argument = Arguments[ArgumentIndex];
+		if(StringMatch(Argument, "--help"))
+		{
+			PrintUsage(Arguments[0]);
+			return(false);
+		}
+		// NOTE(hugo): --headless alone turns it on, followed by
+		// a value it is a key like the others (on/off).
+		else if(StringMatch(Argument, "--headless") &&
+				(ArgumentIndex + 1 >= ArgumentCount || Arguments[ArgumentIndex + 1][0] == '-'))
+		{
+			Config->Headless = true;
+		}
+		else if(StringMatch(Argument, "--config"))
+		{
+			++ArgumentIndex;
+		}
+		else if(Argument[0] == '-' && Argument[1] == '-' && ArgumentIndex + 1 < ArgumentCount)
+		{
+			++ArgumentIndex;
+			if(!SetConfigValue(Config, Argument + 2, Arguments[ArgumentIndex]))
+			{
+				return(false);
+			}
+		}
+		else
+		{
+			printf("Unexpected argument '%s'.\n", Argument);
+			PrintUsage(Arguments[0]);
+			return(false);
+		}
+	}
+
+	// NOTE(hugo): The materials are next to the .obj unless told otherwise.
+	if(StringEmpty(Config->MaterialPath))
+	{
+		strcpy(Config->MaterialPath, Config->ScenePath);
+		char* LastSeparator = strrchr(Config->MaterialPath, '/');
+		if(LastSeparator)
+		{
+			*LastSeparator = '\0';
+		}
+		else
+		{
+			strcpy(Config->MaterialPath, ".");
+		}
+	}
+
+	bool Valid = true;
+	if(Config->Width == 0 || Config->Height == 0 ||
+			Config->ChunkWidth == 0 || Config->ChunkHeight == 0 ||
+			Config->SamplesPerTask == 0 || Config->WavefrontBatchSize == 0)
+	{
+		printf("Resolution, tile size, samples per task and batch size must not be zero.\n");
+		Valid = false;
+	}
+
+	// NOTE(hugo): The wavefront integrator has no tiles to tune.
+	if(Config->Integrator == Integrator_Wavefront)
+	{
+		Config->AutoTileSize = false;
+
+		// NOTE(hugo): It numbers the paths of a pass on 32 bits, the
+		// overhang of the last batch included.
+		u64 PathCount = u64(Config->Width) * u64(Config->Height) * u64(Config->SamplesPerTask);
+		if(PathCount + u64(Config->WavefrontBatchSize) > u64(0xFFFFFFFF))
+		{
+			printf("Too many paths per wavefront pass (%llu) : lower the resolution or the samples per task.\n",
+					(unsigned long long)PathCount);
+			Valid = false;
+		}
+	}
+
+#if !RAY_SSE
+	if(Config->PacketSize > 0)
+	{
+		printf("Ray packets need SSE, tracing rays one by one.\n");
+		Config->PacketSize = 0;
+	}
+#endif
+
+	// NOTE(hugo): Benchmarks never need a window.
+	if(Config->QueueBenchmarkTaskCount > 0 || Config->ResolveBenchmarkIterations > 0 ||
+			Config->NormalizeBenchmarkIterations > 0 || Config->BuildBenchmarkIterations > 0 ||
+			Config->RefitBenchmarkFrames > 0)
+	{
+		Config->Headless = true;
+	}
+
+	if(Config->TileOrder == TileOrder_Default)
+	{
+		Config->TileOrder = Config->Headless ? TileOrder_Hilbert : TileOrder_CentreOut;
+	}
+
+	if(Config->PassCount == 0)
+	{
+		Config->PassCount = Config->Headless ? 64 : 20000;
+	}
+
+	return(Valid);
+}
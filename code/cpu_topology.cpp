@@ -0,0 +1,176 @@
+#pragma once
+
+// NOTE(hugo): What we know about the logical CPUs of the machine, used
+// to size the thread pool and to decide where each worker is pinned.
+// Only Linux exposes the full topology (through sysfs), elsewhere every
+// logical CPU is considered to be its own core on a single node.
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+enum thread_pinning
+{
+	ThreadPinning_None,
+	// NOTE(hugo): One worker per physical core first, SMT siblings last.
+	ThreadPinning_Spread,
+	// NOTE(hugo): Fill every SMT sibling of a core before the next core.
+	ThreadPinning_Compact,
+};
+
+struct logical_cpu
+{
+	u32 ID;
+	u32 Package;
+	u32 Core;
+	u32 Node;
+	// NOTE(hugo): 0 for the first hardware thread of a core, 1 for its sibling...
+	u32 SMTRank;
+};
+
+struct cpu_topology
+{
+	u32 LogicalCount;
+	u32 PhysicalCoreCount;
+	u32 NodeCount;
+	logical_cpu* CPUs;
+};
+
+#ifdef __linux__
+internal bool
+ReadSysfsU32(char* Path, u32* Value)
+{
+	FILE* File = fopen(Path, "r");
+	if(!File)
+	{
+		return(false);
+	}
+	bool Valid = (fscanf(File, "%u", Value) == 1);
+	fclose(File);
+	return(Valid);
+}
+#endif
+
+internal cpu_topology
+QueryCPUTopology(memory_arena* Arena)
+{
+	cpu_topology Topology = {};
+	s32 CPUCount = SDL_GetCPUCount();
+	Topology.LogicalCount = (CPUCount > 0) ? u32(CPUCount) : 1;
+	Topology.CPUs = PushArray(Arena, Topology.LogicalCount, logical_cpu);
+
+	for(u32 CPUIndex = 0; CPUIndex < Topology.LogicalCount; ++CPUIndex)
+	{
+		logical_cpu* CPU = Topology.CPUs + CPUIndex;
+		CPU->ID = CPUIndex;
+		CPU->Core = CPUIndex;
+#ifdef __linux__
+		char Path[128];
+		snprintf(Path, sizeof(Path), "/sys/devices/system/cpu/cpu%u/topology/core_id", CPUIndex);
+		ReadSysfsU32(Path, &CPU->Core);
+		snprintf(Path, sizeof(Path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", CPUIndex);
+		ReadSysfsU32(Path, &CPU->Package);
+
+		// NOTE(hugo): The NUMA node shows up as a "nodeN" entry in the cpu folder.
+		snprintf(Path, sizeof(Path), "/sys/devices/system/cpu/cpu%u", CPUIndex);
+		DIR* Directory = opendir(Path);
+		if(Directory)
+		{
+			struct dirent* Entry = 0;
+			while((Entry = readdir(Directory)))
+			{
+				u32 Node = 0;
+				if(sscanf(Entry->d_name, "node%u", &Node) == 1)
+				{
+					CPU->Node = Node;
+				}
+			}
+			closedir(Directory);
+		}
+#endif
+	}
+
+	for(u32 CPUIndex = 0; CPUIndex < Topology.LogicalCount; ++CPUIndex)
+	{
+		logical_cpu* CPU = Topology.CPUs + CPUIndex;
+		for(u32 OtherIndex = 0; OtherIndex < CPUIndex; ++OtherIndex)
+		{
+			logical_cpu* Other = Topology.CPUs + OtherIndex;
+			if(Other->Package == CPU->Package && Other->Core == CPU->Core)
+			{
+				++CPU->SMTRank;
+			}
+		}
+
+		if(CPU->SMTRank == 0)
+		{
+			++Topology.PhysicalCoreCount;
+		}
+		if(CPU->Node + 1 > Topology.NodeCount)
+		{
+			Topology.NodeCount = CPU->Node + 1;
+		}
+	}
+
+	return(Topology);
+}
+
+internal bool
+ComesBefore(logical_cpu* A, logical_cpu* B, thread_pinning Pinning)
+{
+	if(Pinning == ThreadPinning_Spread && A->SMTRank != B->SMTRank)
+	{
+		return(A->SMTRank < B->SMTRank);
+	}
+	if(A->Node != B->Node)
+	{
+		return(A->Node < B->Node);
+	}
+	if(A->Package != B->Package)
+	{
+		return(A->Package < B->Package);
+	}
+	if(A->Core != B->Core)
+	{
+		return(A->Core < B->Core);
+	}
+	return(A->SMTRank < B->SMTRank);
+}
+
+// NOTE(hugo): Sorts the CPUs in the order workers are pinned to them.
+// The main thread takes the first one.
+internal void
+SortCPUsForPinning(cpu_topology* Topology, thread_pinning Pinning)
+{
+	for(u32 CPUIndex = 1; CPUIndex < Topology->LogicalCount; ++CPUIndex)
+	{
+		logical_cpu CPU = Topology->CPUs[CPUIndex];
+		u32 InsertIndex = CPUIndex;
+		while(InsertIndex > 0 && ComesBefore(&CPU, Topology->CPUs + InsertIndex - 1, Pinning))
+		{
+			Topology->CPUs[InsertIndex] = Topology->CPUs[InsertIndex - 1];
+			--InsertIndex;
+		}
+		Topology->CPUs[InsertIndex] = CPU;
+	}
+}
+
+internal bool
+PinCurrentThreadToCPU(u32 CPUID)
+{
+#ifdef _WIN32
+	bool Result = (CPUID < 64) && (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << CPUID) != 0);
+#elif defined(__linux__)
+	cpu_set_t Set;
+	CPU_ZERO(&Set);
+	CPU_SET(CPUID, &Set);
+	bool Result = (pthread_setaffinity_np(pthread_self(), sizeof(Set), &Set) == 0);
+#else
+	bool Result = false;
+#endif
+	return(Result);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+// NOTE(hugo): Image output used when rendering without a window.
+// PFM stores the linear float values as they are, PPM stores the
+// 8-bit sRGB pixels as they would have been displayed.
+
+internal bool
+WritePFM(char* Filename, u32 Width, u32 Height, v3* Pixels, float Scale)
+{
+	FILE* OutputFile = fopen(Filename, "wb");
+	if(!OutputFile)
+	{
+		printf("Could not open %s for writing.\n", Filename);
+		return(false);
+	}
+
+	// NOTE(hugo): A negative scale means little-endian data.
+	fprintf(OutputFile, "PF\n%u %u\n-1.0\n", Width, Height);
+
+	// NOTE(hugo): PFM scanlines are stored bottom to top.
+	float* Scanline = AllocateArray(float, 3 * Width);
+	for(u32 Y = 0; Y < Height; ++Y)
+	{
+		v3* Row = Pixels + (Height - 1 - Y) * Width;
+		for(u32 X = 0; X < Width; ++X)
+		{
+			v3 Color = Scale * Row[X];
+			Scanline[3 * X + 0] = Color.r;
+			Scanline[3 * X + 1] = Color.g;
+			Scanline[3 * X + 2] = Color.b;
+		}
+		fwrite(Scanline, sizeof(float), 3 * Width, OutputFile);
+	}
+	Free(Scanline);
+
+	fclose(OutputFile);
+	return(true);
+}
+
+// NOTE(hugo): Reads a PFM written by WritePFM (RGB, little-endian)
+// into Pixels, which must hold Width * Height values. Fails if the
+// file is missing or its size is not Width x Height.
+internal bool
+ReadPFM(char* Filename, u32 Width, u32 Height, v3* Pixels)
+{
+	FILE* InputFile = fopen(Filename, "rb");
+	if(!InputFile)
+	{
+		return(false);
+	}
+
+	u32 FileWidth = 0;
+	u32 FileHeight = 0;
+	float Scale = 0.0f;
+	bool Valid = (fscanf(InputFile, "PF %u %u %f", &FileWidth, &FileHeight, &Scale) == 3) &&
+		(fgetc(InputFile) == '\n') && (FileWidth == Width) && (FileHeight == Height) && (Scale < 0.0f);
+	if(Valid)
+	{
+		float* Scanline = AllocateArray(float, 3 * Width);
+		for(u32 Y = 0; Valid && (Y < Height); ++Y)
+		{
+			Valid = (fread(Scanline, sizeof(float), 3 * Width, InputFile) == 3 * Width);
+			v3* Row = Pixels + (Height - 1 - Y) * Width;
+			for(u32 X = 0; Valid && (X < Width); ++X)
+			{
+				Row[X] = V3(Scanline[3 * X + 0], Scanline[3 * X + 1], Scanline[3 * X + 2]);
+			}
+		}
+		Free(Scanline);
+	}
+
+	fclose(InputFile);
+	return(Valid);
+}
+
+// NOTE(hugo): Root mean square error between the Scale * Pixels and
+// the Reference, on every channel clamped to [0, 1] as it would be
+// displayed : the lights are far above 1 and would hide the rest.
+internal double
+ClampedRMSE(v3* Pixels, float Scale, v3* Reference, u32 PixelCount)
+{
+	double SquaredErrorSum = 0.0;
+	for(u32 PixelIndex = 0; PixelIndex < PixelCount; ++PixelIndex)
+	{
+		v3 Error = Clamp01(Scale * Pixels[PixelIndex]) - Clamp01(Reference[PixelIndex]);
+		SquaredErrorSum += double(LengthSqr(Error));
+	}
+	double Result = (PixelCount > 0) ? sqrt(SquaredErrorSum / double(3 * PixelCount)) : 0.0;
+	return(Result);
+}
+
+internal bool
+WritePPM(char* Filename, u32 Width, u32 Height, u32* Pixels)
+{
+	FILE* OutputFile = fopen(Filename, "wb");
+	if(!OutputFile)
+	{
+		printf("Could not open %s for writing.\n", Filename);
+		return(false);
+	}
+
+	fprintf(OutputFile, "P6\n%u %u\n255\n", Width, Height);
+
+	u8* Scanline = AllocateArray(u8, 3 * Width);
+	for(u32 Y = 0; Y < Height; ++Y)
+	{
+		u32* Row = Pixels + Y * Width;
+		for(u32 X = 0; X < Width; ++X)
+		{
+			u32 Pixel = Row[X];
+			Scanline[3 * X + 0] = (u8)((Pixel >> 16) & 0xFF);
+			Scanline[3 * X + 1] = (u8)((Pixel >> 8) & 0xFF);
+			Scanline[3 * X + 2] = (u8)((Pixel >> 0) & 0xFF);
+		}
+		fwrite(Scanline, 1, 3 * Width, OutputFile);
+	}
+	Free(Scanline);
+
+	fclose(OutputFile);
+	return(true);
+}
@@ -131,12 +131,15 @@ RayHitBoundingBox(ray Ray, rect3 BoundingBox)
 internal void
 RayTriangleIntersection(ray Ray, triangle T, vertex* Vertices, hit_record* ClosestHitRecord)
 {
+	TRAVERSAL_STAT(TrianglesTested);
 	v3 v0 = Vertices[T.Indices[0]].P;
 	v3 v1 = Vertices[T.Indices[1]].P;
 	v3 v2 = Vertices[T.Indices[2]].P;
 	v3 e1 = v1 - v0;
 	v3 e2 = v2 - v0;
-	v3 TriangleNormal = Normalized(Cross(e1, e2));
+	// NOTE(hugo): Only the sign of the dot with the ray matters,
+	// the normal does not need to be of unit length.
+	v3 TriangleNormal = Cross(e1, e2);
 
 	v3 q = Cross(Ray.Dir, e2);
 	float a = Dot(q, e1);
@@ -173,12 +176,13 @@ RayTriangleIntersection(ray Ray, triangle T, vertex* Vertices, hit_record* Close
 	// NOTE(hugo): We hit !
 	if(t < ClosestHitRecord->t)
 	{
+		TRAVERSAL_STAT(Hits);
 		ClosestHitRecord->t = t;
 		ClosestHitRecord->P = Ray.Start + t * Ray.Dir;
 		v3 n0 = Vertices[T.Indices[0]].N;
 		v3 n1 = Vertices[T.Indices[1]].N;
 		v3 n2 = Vertices[T.Indices[2]].N;
-		v3 N = Normalized(BarycentricCoords.x * n0 + BarycentricCoords.y * n1 + BarycentricCoords.z * n2);
+		v3 N = NormalizedFast(BarycentricCoords.x * n0 + BarycentricCoords.y * n1 + BarycentricCoords.z * n2);
 		ClosestHitRecord->N = N;
 
 		// TODO(hugo): Implement material
@@ -210,7 +214,7 @@ RaySphereIntersection(sphere* S, ray Ray, hit_record* ClosestHitRecord)
 				ClosestHitRecord->t = t0;
 				ClosestHitRecord->P = Ray.Start + t0 * Ray.Dir;
 				// TODO(hugo): @Optim : we know that the norm is radius ?
-				ClosestHitRecord->N = Normalized(ClosestHitRecord->P - S->P);
+				ClosestHitRecord->N = NormalizedFast(ClosestHitRecord->P - S->P);
 				ClosestHitRecord->MaterialIndex = S->MaterialIndex;
 			}
 		}
@@ -229,7 +233,7 @@ RaySphereIntersection(sphere* S, ray Ray, hit_record* ClosestHitRecord)
 				ClosestHitRecord->t = t1;
 				ClosestHitRecord->P = Ray.Start + t1 * Ray.Dir;
 				// TODO(hugo): @Optim : we know that the norm is radius ?
-				ClosestHitRecord->N = Normalized(ClosestHitRecord->P - S->P);
+				ClosestHitRecord->N = NormalizedFast(ClosestHitRecord->P - S->P);
 				ClosestHitRecord->MaterialIndex = S->MaterialIndex;
 			}
 		}
@@ -247,8 +251,10 @@ internal void
 RayKdTreeIntersection(ray Ray, kdtree* Node, render_state* RenderState, hit_record* ClosestHitRecord)
 {
 	rect3 NodeBoundingBox = Node->BoundingBox;
+	TRAVERSAL_STAT(BoxesTested);
 	if(RayHitBoundingBox(Ray, NodeBoundingBox))
 	{
+		TRAVERSAL_STAT(NodesVisited);
 		kdtree* Left = GetKDTreeFromPool(Node->LeftIndex, RenderState);
 		if(Left)
 		{
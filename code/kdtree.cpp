@@ -60,6 +60,17 @@ struct plane
 	float k;
 };
 
+// NOTE(hugo): The split kernels are instantiated once per axis so
+// that the axis is a constant inside their loops, and the functions
+// without the Axis suffix dispatch on it once per node.
+template<plane_axis Axis> inline plane
+FindSeparatingPlaneAxis(kdtree* Tree)
+{
+	float Midpoint = 0.5f * (Tree->BoundingBox.Max.E[Axis] + Tree->BoundingBox.Min.E[Axis]);
+	plane Result = {Axis, Midpoint};
+	return(Result);
+}
+
 internal plane
 FindSeparatingPlane(kdtree* Tree, u32 CurrentDepth)
 {
@@ -74,134 +85,212 @@ FindSeparatingPlane(kdtree* Tree, u32 CurrentDepth)
 	{
 		case 0:
 			{
-				// NOTE(hugo): X Axis
-				float Midpoint = 0.5f * (Tree->BoundingBox.Max.x + Tree->BoundingBox.Min.x);
-				Result = {Plane_X, Midpoint};
+				Result = FindSeparatingPlaneAxis<Plane_X>(Tree);
 			} break;
 		case 1:
 			{
-				// NOTE(hugo): Y Axis
-				float Midpoint = 0.5f * (Tree->BoundingBox.Max.y + Tree->BoundingBox.Min.y);
-				Result = {Plane_Y, Midpoint};
+				Result = FindSeparatingPlaneAxis<Plane_Y>(Tree);
 			} break;
 		case 2:
 			{
-				// NOTE(hugo): Z Axis
-				float Midpoint = 0.5f * (Tree->BoundingBox.Max.z + Tree->BoundingBox.Min.z);
-				Result = {Plane_Z, Midpoint};
+				Result = FindSeparatingPlaneAxis<Plane_Z>(Tree);
 			} break;
 		InvalidDefaultCase;
 	}
 	return(Result);
 }
 
-struct triangle_plane_separation_result
+/* NOTE(hugo)
+ *    What the build reads of each triangle, computed once before the
+ *    build : its isobarycenter, one array per axis, and its bounding
+ *    box padded to 4 floats. The partition swaps these entries along
+ *    with the triangles, so that entry i always describes
+ *    Triangles[i], and never has to go through the vertex indices.
+ */
+struct kdtree_build_buffer
 {
-	u32 LeftTriangleCount;
-	u32 RightTriangleCount;
+	triangle* Triangles;
+	float* Centroids[3];
+	v4* BoundsMin;
+	v4* BoundsMax;
 };
 
-internal v3
-GetIsobarycenter(triangle* T, render_state* RenderState)
+// NOTE(hugo): Bounds of the triangles sent to one side of a plane,
+// grown while they are partitioned.
+#if RAY_SSE
+struct bounds_accumulator
 {
-	v3 Result = {};
-	Result += RenderState->Vertices[T->Indices[0]].P;
-	Result += RenderState->Vertices[T->Indices[1]].P;
-	Result += RenderState->Vertices[T->Indices[2]].P;
-	Result /= 3.0f;
+	f32x4 Min;
+	f32x4 Max;
+};
 
+inline bounds_accumulator
+EmptyBounds(void)
+{
+	bounds_accumulator Result = {F32x4(MAX_REAL), F32x4(MIN_REAL)};
 	return(Result);
 }
 
-internal triangle_plane_separation_result
-TrianglePlaneSeparation(kdtree* Tree, plane P, render_state* RenderState)
+inline void
+ExtendBounds(bounds_accumulator* Bounds, v4* Min, v4* Max)
 {
-	triangle_plane_separation_result Result = {};
-	triangle* CurrentTriangle = Tree->Triangles;
-	triangle* ToWriteRight = Tree->Triangles + (Tree->TriangleCount - 1);
-	while(CurrentTriangle != (ToWriteRight + 1))
+	Bounds->Min = Minf(Bounds->Min, LoadF32x4(&Min->x));
+	Bounds->Max = Maxf(Bounds->Max, LoadF32x4(&Max->x));
+}
+
+inline rect3
+GetBoundingBox(bounds_accumulator Bounds)
+{
+	rect3 Result = {V3(GetLane(Bounds.Min, 0), GetLane(Bounds.Min, 1), GetLane(Bounds.Min, 2)),
+		V3(GetLane(Bounds.Max, 0), GetLane(Bounds.Max, 1), GetLane(Bounds.Max, 2))};
+	return(Result);
+}
+#else
+struct bounds_accumulator
+{
+	v3 Min;
+	v3 Max;
+};
+
+inline bounds_accumulator
+EmptyBounds(void)
+{
+	bounds_accumulator Result = {V3(MAX_REAL, MAX_REAL, MAX_REAL), V3(MIN_REAL, MIN_REAL, MIN_REAL)};
+	return(Result);
+}
+
+inline void
+ExtendBounds(bounds_accumulator* Bounds, v4* Min, v4* Max)
+{
+	Bounds->Min = V3(Minf(Bounds->Min.x, Min->x), Minf(Bounds->Min.y, Min->y), Minf(Bounds->Min.z, Min->z));
+	Bounds->Max = V3(Maxf(Bounds->Max.x, Max->x), Maxf(Bounds->Max.y, Max->y), Maxf(Bounds->Max.z, Max->z));
+}
+
+inline rect3
+GetBoundingBox(bounds_accumulator Bounds)
+{
+	rect3 Result = {Bounds.Min, Bounds.Max};
+	return(Result);
+}
+#endif
+
+internal kdtree_build_buffer
+CreateKdTreeBuildBuffer(memory_arena* Arena, triangle* Triangles, u32 TriangleCount, vertex* Vertices)
+{
+	kdtree_build_buffer Result = {};
+	Result.Triangles = Triangles;
+	for(u32 Axis = 0; Axis < 3; ++Axis)
 	{
-		// TODO(hugo): Is the isobarycenter the right choice here ?
-		v3 IsoBar = GetIsobarycenter(CurrentTriangle, RenderState);
-
-		// TODO(hugo): If I _know_ that the planes are one of 
-		// three possibilities, why not do three functions
-		// TrianglePlaneSeparation_X/Y/Z ?
-		float IsoBarComponent = 0.0f;
-		switch(P.Axis)
+		Result.Centroids[Axis] = PushArray(Arena, TriangleCount, float, Align(64, false));
+	}
+	Result.BoundsMin = PushArray(Arena, TriangleCount, v4, Align(64, false));
+	Result.BoundsMax = PushArray(Arena, TriangleCount, v4, Align(64, false));
+
+	for(u32 TriangleIndex = 0; TriangleIndex < TriangleCount; ++TriangleIndex)
+	{
+		triangle* T = Triangles + TriangleIndex;
+		v3 P0 = Vertices[T->Indices[0]].P;
+		v3 P1 = Vertices[T->Indices[1]].P;
+		v3 P2 = Vertices[T->Indices[2]].P;
+		for(u32 Axis = 0; Axis < 3; ++Axis)
 		{
-			case Plane_X:
-				{
-					IsoBarComponent = IsoBar.x;
-				} break;
-			case Plane_Y:
-				{
-					IsoBarComponent = IsoBar.y;
-				} break;
-			case Plane_Z:
-				{
-					IsoBarComponent = IsoBar.z;
-				} break;
-			InvalidDefaultCase;
+			// TODO(hugo): Is the isobarycenter the right choice here ?
+			Result.Centroids[Axis][TriangleIndex] = (P0.E[Axis] + P1.E[Axis] + P2.E[Axis]) * (1.0f / 3.0f);
 		}
+		Result.BoundsMin[TriangleIndex] = V4(Minf(Minf(P0.x, P1.x), P2.x), Minf(Minf(P0.y, P1.y), P2.y),
+				Minf(Minf(P0.z, P1.z), P2.z), 0.0f);
+		Result.BoundsMax[TriangleIndex] = V4(Maxf(Maxf(P0.x, P1.x), P2.x), Maxf(Maxf(P0.y, P1.y), P2.y),
+				Maxf(Maxf(P0.z, P1.z), P2.z), 0.0f);
+	}
 
-		if(IsoBarComponent <= P.k)
+	return(Result);
+}
+
+inline void
+SwapBuildEntries(kdtree_build_buffer* Build, u32 A, u32 B)
+{
+	triangle TempTriangle = Build->Triangles[A];
+	Build->Triangles[A] = Build->Triangles[B];
+	Build->Triangles[B] = TempTriangle;
+	for(u32 Axis = 0; Axis < 3; ++Axis)
+	{
+		float TempCentroid = Build->Centroids[Axis][A];
+		Build->Centroids[Axis][A] = Build->Centroids[Axis][B];
+		Build->Centroids[Axis][B] = TempCentroid;
+	}
+	v4 TempMin = Build->BoundsMin[A];
+	Build->BoundsMin[A] = Build->BoundsMin[B];
+	Build->BoundsMin[B] = TempMin;
+	v4 TempMax = Build->BoundsMax[A];
+	Build->BoundsMax[A] = Build->BoundsMax[B];
+	Build->BoundsMax[B] = TempMax;
+}
+
+struct triangle_plane_separation_result
+{
+	u32 LeftTriangleCount;
+	u32 RightTriangleCount;
+	rect3 LeftBoundingBox;
+	rect3 RightBoundingBox;
+};
+
+// NOTE(hugo): Partition of the triangles of the node around the
+// plane, that also gives the bounding box of both sides.
+template<plane_axis Axis> internal triangle_plane_separation_result
+TrianglePlaneSeparationAxis(kdtree* Tree, float k, kdtree_build_buffer* Build)
+{
+	triangle_plane_separation_result Result = {};
+	bounds_accumulator LeftBounds = EmptyBounds();
+	bounds_accumulator RightBounds = EmptyBounds();
+	float* Centroids = Build->Centroids[Axis];
+	u32 Current = u32(Tree->Triangles - Build->Triangles);
+	u32 End = Current + Tree->TriangleCount;
+	while(Current != End)
+	{
+		if(Centroids[Current] <= k)
 		{
 			// NOTE(hugo): The triangle is
 			// currently at the right place.
-			++CurrentTriangle;
+			ExtendBounds(&LeftBounds, Build->BoundsMin + Current, Build->BoundsMax + Current);
+			++Current;
 			++Result.LeftTriangleCount;
 		}
 		else
 		{
-			triangle TempTriangle = *ToWriteRight;
-			*ToWriteRight = *CurrentTriangle;
-			*CurrentTriangle = TempTriangle;
+			--End;
+			SwapBuildEntries(Build, Current, End);
+			ExtendBounds(&RightBounds, Build->BoundsMin + End, Build->BoundsMax + End);
 			++Result.RightTriangleCount;
-			--ToWriteRight;
 		}
 	}
+	Result.LeftBoundingBox = GetBoundingBox(LeftBounds);
+	Result.RightBoundingBox = GetBoundingBox(RightBounds);
 
 	return(Result);
 }
 
-internal void
-ComputeBoundingBox(kdtree* Tree, render_state* RenderState)
+internal triangle_plane_separation_result
+TrianglePlaneSeparation(kdtree* Tree, plane P, kdtree_build_buffer* Build)
 {
-	Tree->BoundingBox = {V3(MAX_REAL, MAX_REAL, MAX_REAL),
-		V3(MIN_REAL, MIN_REAL, MIN_REAL)};
-	for(u32 TriangleIndex = 0; TriangleIndex < Tree->TriangleCount; ++TriangleIndex)
+	triangle_plane_separation_result Result = {};
+	switch(P.Axis)
 	{
-		triangle* T = Tree->Triangles + TriangleIndex;
-		for(u32 VertexIndex = 0; VertexIndex < 3; ++VertexIndex)
-		{
-			v3 P = RenderState->Vertices[T->Indices[VertexIndex]].P;
-			if(P.x > Tree->BoundingBox.Max.x)
+		case Plane_X:
 			{
-				Tree->BoundingBox.Max.x = P.x;
-			}
-			if(P.y > Tree->BoundingBox.Max.y)
-			{
-				Tree->BoundingBox.Max.y = P.y;
-			}
-			if(P.z > Tree->BoundingBox.Max.z)
-			{
-				Tree->BoundingBox.Max.z = P.z;
-			}
-			if(P.x < Tree->BoundingBox.Min.x)
-			{
-				Tree->BoundingBox.Min.x = P.x;
-			}
-			if(P.y < Tree->BoundingBox.Min.y)
+				Result = TrianglePlaneSeparationAxis<Plane_X>(Tree, P.k, Build);
+			} break;
+		case Plane_Y:
 			{
-				Tree->BoundingBox.Min.y = P.y;
-			}
-			if(P.z < Tree->BoundingBox.Min.z)
+				Result = TrianglePlaneSeparationAxis<Plane_Y>(Tree, P.k, Build);
+			} break;
+		case Plane_Z:
 			{
-				Tree->BoundingBox.Min.z = P.z;
-			}
-		}
+				Result = TrianglePlaneSeparationAxis<Plane_Z>(Tree, P.k, Build);
+			} break;
+		InvalidDefaultCase;
 	}
+
+	return(Result);
 }
 
 internal kdtree* GetKDTreeFromPool(u32 Index, render_state* RenderState);
@@ -209,16 +298,38 @@ internal u32 CreateKDTree(render_state* RenderState);
 internal kdtree* CreateKDTreeRoot(render_state* RenderState);
 
 internal void
-BuildKdTree(kdtree* Tree, u32 CurrentDepth, render_state* RenderState)
+BuildKdTree(kdtree* Tree, u32 CurrentDepth, kdtree_build_buffer* Build, render_state* RenderState)
 {
 	if(KdTreeEndBuild(Tree))
 	{
 		return;
 	}
 	plane P = FindSeparatingPlane(Tree, CurrentDepth);
-	triangle_plane_separation_result Separation = TrianglePlaneSeparation(Tree, P, RenderState);
+	triangle_plane_separation_result Separation = TrianglePlaneSeparation(Tree, P, Build);
 	Assert(Separation.LeftTriangleCount + Separation.RightTriangleCount == Tree->TriangleCount);
 
+	// NOTE(hugo): When every isobarycenter falls on the same side of
+	// the three planes (many triangles sharing it, like the faces of a
+	// tessellated sphere around a pole) the child would be this node
+	// again, and the recursion would never end : keep it as a leaf.
+	// One empty side alone is fine, the next axis might split it.
+	if(Separation.LeftTriangleCount == 0 || Separation.RightTriangleCount == 0)
+	{
+		bool Separable = false;
+		for(u32 AxisOffset = 1; !Separable && (AxisOffset < 3); ++AxisOffset)
+		{
+			triangle_plane_separation_result OtherSeparation =
+				TrianglePlaneSeparation(Tree, FindSeparatingPlane(Tree, CurrentDepth + AxisOffset), Build);
+			Separable = (OtherSeparation.LeftTriangleCount != 0) && (OtherSeparation.RightTriangleCount != 0);
+		}
+		if(!Separable)
+		{
+			return;
+		}
+		// NOTE(hugo): The other planes shuffled the triangles.
+		Separation = TrianglePlaneSeparation(Tree, P, Build);
+	}
+
 	Tree->LeftIndex = CreateKDTree(RenderState);
 	kdtree* LeftTree = GetKDTreeFromPool(Tree->LeftIndex, RenderState);
 	Tree->RightIndex = CreateKDTree(RenderState);
@@ -226,13 +337,13 @@ BuildKdTree(kdtree* Tree, u32 CurrentDepth, render_state* RenderState)
 
 	LeftTree->TriangleCount = Separation.LeftTriangleCount;
 	LeftTree->Triangles = Tree->Triangles;
-	ComputeBoundingBox(LeftTree, RenderState);
-	BuildKdTree(LeftTree, CurrentDepth + 1, RenderState);
+	LeftTree->BoundingBox = Separation.LeftBoundingBox;
+	BuildKdTree(LeftTree, CurrentDepth + 1, Build, RenderState);
 
 	RightTree->TriangleCount = Separation.RightTriangleCount;
 	RightTree->Triangles = Tree->Triangles + Separation.LeftTriangleCount;
-	ComputeBoundingBox(RightTree, RenderState);
-	BuildKdTree(RightTree, CurrentDepth + 1, RenderState);
+	RightTree->BoundingBox = Separation.RightBoundingBox;
+	BuildKdTree(RightTree, CurrentDepth + 1, Build, RenderState);
 
 	// NOTE(hugo): Let's say that this node
 	// does not contain any triangles.
@@ -240,6 +351,172 @@ BuildKdTree(kdtree* Tree, u32 CurrentDepth, render_state* RenderState)
 	Tree->Triangles = 0;
 }
 
+// NOTE(hugo): The build buffer only lives during the build, in a
+// temporary block of the render arena : the nodes are pushed on the
+// scene arena and have to stay contiguous.
+internal void
+BuildSceneKdTree(kdtree* Root, render_state* RenderState)
+{
+	temporary_memory BuildMemory = BeginTemporaryMemory(&RenderState->Arena);
+	kdtree_build_buffer Build = CreateKdTreeBuildBuffer(&RenderState->Arena,
+			Root->Triangles, Root->TriangleCount, RenderState->Vertices);
+	BuildKdTree(Root, 0, &Build, RenderState);
+	EndTemporaryMemory(BuildMemory);
+}
+
+internal void BuildSceneLBVH(kdtree* Root, render_state* RenderState);
+
+internal void
+BuildSceneTree(kdtree* Root, render_state* RenderState)
+{
+	switch(RenderState->Config.TreeBuilder)
+	{
+		case TreeBuilder_KdTree:
+			{
+				BuildSceneKdTree(Root, RenderState);
+			} break;
+		case TreeBuilder_LBVH:
+			{
+				BuildSceneLBVH(Root, RenderState);
+			} break;
+		InvalidDefaultCase;
+	}
+}
+
+#define SAH_TRAVERSAL_COST 1.0f
+#define SAH_INTERSECTION_COST 1.0f
+
+inline float
+RectSurfaceArea(rect3 Rect)
+{
+	v3 Size = RectSize(Rect);
+	float Result = 0.0f;
+	if(Size.x >= 0.0f && Size.y >= 0.0f && Size.z >= 0.0f)
+	{
+		Result = 2.0f * (Size.x * Size.y + Size.y * Size.z + Size.z * Size.x);
+	}
+	return(Result);
+}
+
+// NOTE(hugo): Share of a node in the SAH cost of its tree, times the
+// area of the root : an empty leaf has no box and costs nothing.
+inline float
+SAHNodeCost(kdtree* Node)
+{
+	float Cost = (Node->LeftIndex == KD_TREE_NO_CHILD) ?
+		SAH_INTERSECTION_COST * float(Node->TriangleCount) : SAH_TRAVERSAL_COST;
+	float Result = Cost * RectSurfaceArea(Node->BoundingBox);
+	return(Result);
+}
+
+// NOTE(hugo): Bottom-up boxes, for the builders and refits that run
+// on many threads at once. NodeIndex has just got its box : as long as
+// this thread is the second one done with both children of the parent
+// (Children holds two per node), it merges their boxes into the parent
+// and goes up. The visit count goes back to 0 for the next pass, and
+// the SAH cost of the merged nodes is added to Cost when asked for.
+internal void
+PropagateBoxesUp(kdtree* Nodes, u32 NodeIndex, u32* Parents, u32* Children,
+		u32 volatile* Visits, float* Cost)
+{
+	while(NodeIndex != 0)
+	{
+		u32 ParentIndex = Parents[NodeIndex];
+		// NOTE(hugo): The atomic add also makes the box of
+		// the other child, written before its own add, visible.
+		if(SDL_AtomicAdd((SDL_atomic_t *)(Visits + ParentIndex), 1) == 0)
+		{
+			break;
+		}
+		Visits[ParentIndex] = 0;
+
+		kdtree* Parent = Nodes + ParentIndex;
+		rect3 LeftBox = Nodes[Children[2 * ParentIndex + 0]].BoundingBox;
+		rect3 RightBox = Nodes[Children[2 * ParentIndex + 1]].BoundingBox;
+		Parent->BoundingBox = {
+			V3(Minf(LeftBox.Min.x, RightBox.Min.x), Minf(LeftBox.Min.y, RightBox.Min.y), Minf(LeftBox.Min.z, RightBox.Min.z)),
+			V3(Maxf(LeftBox.Max.x, RightBox.Max.x), Maxf(LeftBox.Max.y, RightBox.Max.y), Maxf(LeftBox.Max.z, RightBox.Max.z))};
+		if(Cost)
+		{
+			*Cost += SAHNodeCost(Parent);
+		}
+		NodeIndex = ParentIndex;
+	}
+}
+
+// NOTE(hugo): Back to a root holding every triangle, for a new build
+// from the box the root has now. The nodes are the last thing in the
+// scene arena : all but the root are popped so that the new ones are
+// pushed where their indices point.
+internal kdtree*
+ResetSceneTree(render_state* RenderState)
+{
+	kdtree* Root = RenderState->Trees;
+	memory_arena* SceneArena = &RenderState->SceneArena;
+	Assert(SceneArena->TemporaryCount == 0);
+	Assert(SceneArena->Base + SceneArena->Used == (u8 *)(RenderState->Trees + RenderState->TreeCount));
+	memory_index PoppedSize = (RenderState->TreeCount - 1) * sizeof(kdtree);
+	SceneArena->Used -= PoppedSize;
+	SceneArena->TaggedSize[MemoryTag_TreeNodes] -= PoppedSize;
+	SetArenaTag(SceneArena, MemoryTag_TreeNodes);
+
+	RenderState->TreeCount = 1;
+	Root->LeftIndex = KD_TREE_NO_CHILD;
+	Root->RightIndex = KD_TREE_NO_CHILD;
+	Root->TriangleCount = RenderState->TriangleCount;
+	Root->Triangles = RenderState->Triangles;
+
+	return(Root);
+}
+
+// NOTE(hugo): Only the nodes reached from the root : the pool also
+// holds the LBVH subtrees under the nodes that became leaves.
+internal u32
+CountTreeNodes(kdtree* Nodes, u32 NodeIndex, u32* LeafCount)
+{
+	kdtree* Node = Nodes + NodeIndex;
+	u32 Result = 1;
+	if(Node->LeftIndex == KD_TREE_NO_CHILD)
+	{
+		++*LeafCount;
+	}
+	else
+	{
+		Result += CountTreeNodes(Nodes, Node->LeftIndex, LeafCount);
+		Result += CountTreeNodes(Nodes, Node->RightIndex, LeafCount);
+	}
+	return(Result);
+}
+
+internal void
+RunBuildBenchmark(render_state* RenderState, u32 Iterations)
+{
+	double PerformanceFrequency = double(SDL_GetPerformanceFrequency());
+	double TotalSeconds = 0.0;
+	double BestSeconds = MAX_FLOAT32;
+	for(u32 Iteration = 0; Iteration < Iterations; ++Iteration)
+	{
+		kdtree* Root = ResetSceneTree(RenderState);
+
+		u64 Start = SDL_GetPerformanceCounter();
+		BuildSceneTree(Root, RenderState);
+		double Seconds = double(SDL_GetPerformanceCounter() - Start) / PerformanceFrequency;
+		TotalSeconds += Seconds;
+		if(Seconds < BestSeconds)
+		{
+			BestSeconds = Seconds;
+		}
+	}
+
+	u32 LeafCount = 0;
+	u32 NodeCount = CountTreeNodes(RenderState->Trees, 0, &LeafCount);
+	printf("Build benchmark: %u triangles, %u nodes (%u leaves, %u in the pool), %u builds\n",
+			RenderState->TriangleCount, NodeCount, LeafCount, RenderState->TreeCount, Iterations);
+	printf("\t%.3f ms per build (best %.3f ms), %.2f Mtriangles/s\n",
+			1000.0 * TotalSeconds / double(Iterations), 1000.0 * BestSeconds,
+			double(RenderState->TriangleCount) / (1000000.0 * BestSeconds));
+}
+
 internal void
 DEBUGOutputTreeGraphvizRec(FILE* f, kdtree* Node, u32 NodeIndex, render_state* RenderState)
 {
@@ -287,6 +564,8 @@ IsZero(v3 V)
 internal void
 LoadKDTreeFromFile(char* Filename, char* MTLDir, render_state* RenderState)
 {
+	// NOTE(hugo): The build is a block of its own inside the load.
+	TIMED_BLOCK(Load);
 	tinyobj::attrib_t Attributes = {};
 	std::vector<tinyobj::shape_t> Shapes = {};
 	std::vector<tinyobj::material_t> Materials = {};
@@ -310,6 +589,16 @@ LoadKDTreeFromFile(char* Filename, char* MTLDir, render_state* RenderState)
 		PushMaterial(RenderState, Mat);
 	}
 
+	// NOTE(hugo): For the faces without a material (no .mtl, or no usemtl).
+	u32 DefaultMaterialIndex = RenderState->MaterialCount;
+	{
+		material Mat = {};
+		Mat.Albedo = V3(0.7f, 0.7f, 0.7f);
+		Mat.Attenuation = 0.8f;
+		Mat.Scatter = 1.0f;
+		PushMaterial(RenderState, Mat);
+	}
+
 	// NOTE(hugo): Temporary "on the stack" root,
 	// the real arena allocation of the root will
 	// come after in this function.
@@ -325,11 +614,13 @@ LoadKDTreeFromFile(char* Filename, char* MTLDir, render_state* RenderState)
 	}
 
 	TreeRoot.TriangleCount = 0;
-	TreeRoot.Triangles = PushArray(&RenderState->Arena, TriangleCount, triangle);
+	SetArenaTag(&RenderState->SceneArena, MemoryTag_Triangles);
+	TreeRoot.Triangles = PushArray(&RenderState->SceneArena, TriangleCount, triangle);
 
 	u32 CurrentVertexPoolSize = 16;
 	RenderState->VertexCount = 0;
-	RenderState->Vertices = PushArray(&RenderState->Arena, CurrentVertexPoolSize, vertex);
+	SetArenaTag(&RenderState->SceneArena, MemoryTag_Vertices);
+	RenderState->Vertices = PushArray(&RenderState->SceneArena, CurrentVertexPoolSize, vertex);
 
 	for(u32 ShapeIndex = 0; ShapeIndex < Shapes.size(); ++ShapeIndex)
 	{
@@ -340,23 +631,42 @@ LoadKDTreeFromFile(char* Filename, char* MTLDir, render_state* RenderState)
 		{
 			triangle* Triangle = TreeRoot.Triangles + TreeRoot.TriangleCount;
 			Assert(TriangleIndex < Mesh.material_ids.size());
-			Triangle->MatIndex = Mesh.material_ids[TriangleIndex];
+			s32 MaterialID = Mesh.material_ids[TriangleIndex];
+			Triangle->MatIndex = (MaterialID >= 0) ? u32(MaterialID) : DefaultMaterialIndex;
 			++TreeRoot.TriangleCount;
+
+			v3 FacePositions[3];
 			for(u32 VIndex = 0; VIndex < 3; ++VIndex)
 			{
-				tinyobj::index_t AttributeIndex = Mesh.indices[3 * TriangleIndex + VIndex];
-				s32 PosIndex = AttributeIndex.vertex_index;
+				s32 PosIndex = Mesh.indices[3 * TriangleIndex + VIndex].vertex_index;
 				Assert(PosIndex != -1);
-				vertex V = {};
-				V.P = V3(Attributes.vertices[3 * PosIndex + 0],
+				FacePositions[VIndex] = V3(Attributes.vertices[3 * PosIndex + 0],
 						Attributes.vertices[3 * PosIndex + 1],
 						Attributes.vertices[3 * PosIndex + 2]);
+			}
+			// NOTE(hugo): Vertices without a normal in the file get the
+			// flat normal of the face, with the winding the intersection
+			// uses for its backface test.
+			v3 FaceNormal = Cross(FacePositions[1] - FacePositions[0], FacePositions[2] - FacePositions[0]);
+			FaceNormal = (LengthSqr(FaceNormal) > 0.0f) ? Normalized(FaceNormal) : V3(0.0f, 1.0f, 0.0f);
+
+			for(u32 VIndex = 0; VIndex < 3; ++VIndex)
+			{
+				tinyobj::index_t AttributeIndex = Mesh.indices[3 * TriangleIndex + VIndex];
+				vertex V = {};
+				V.P = FacePositions[VIndex];
 
 				s32 NormalIndex = AttributeIndex.normal_index;
-				Assert(NormalIndex != -1);
-				V.N = V3(Attributes.normals[3 * NormalIndex + 0],
-						Attributes.normals[3 * NormalIndex + 1],
-						Attributes.normals[3 * NormalIndex + 2]);
+				if(NormalIndex != -1)
+				{
+					V.N = V3(Attributes.normals[3 * NormalIndex + 0],
+							Attributes.normals[3 * NormalIndex + 1],
+							Attributes.normals[3 * NormalIndex + 2]);
+				}
+				else
+				{
+					V.N = FaceNormal;
+				}
 
 				u32 VertexIndex = FindVertexIndex(RenderState->VertexCount, RenderState->Vertices, V);
 				if(VertexIndex == VERTEX_NOT_PRESENT)
@@ -364,7 +674,7 @@ LoadKDTreeFromFile(char* Filename, char* MTLDir, render_state* RenderState)
 					if(RenderState->VertexCount == CurrentVertexPoolSize)
 					{
 						// TODO(hugo): Not optimal ?
-						PushStruct(&RenderState->Arena, vertex);
+						PushStruct(&RenderState->SceneArena, vertex);
 						++CurrentVertexPoolSize;
 					}
 
@@ -412,14 +722,24 @@ LoadKDTreeFromFile(char* Filename, char* MTLDir, render_state* RenderState)
 	// NOTE(hugo): We allocate the root in the arena
 	// at the very end so that every tree allocation
 	// in the arena are contiguous.
+	RenderState->TriangleCount = TreeRoot.TriangleCount;
+	RenderState->Triangles = TreeRoot.Triangles;
+	SetArenaTag(&RenderState->SceneArena, MemoryTag_TreeNodes);
 	kdtree* Root = CreateKDTreeRoot(RenderState);
 	Root->TriangleCount = TreeRoot.TriangleCount;
 	Root->Triangles = TreeRoot.Triangles;
 	Root->BoundingBox = TreeRoot.BoundingBox;
 
-	printf("Building the KD Tree...\n");
-	BuildKdTree(Root, 0, RenderState);
-	printf("KD Tree built !\n");
+	char* BuilderName = TreeBuilderNames[RenderState->Config.TreeBuilder];
+	printf("Building the %s...\n", BuilderName);
+	u64 BuildStart = SDL_GetPerformanceCounter();
+	{
+		TIMED_BLOCK(Build);
+		BuildSceneTree(Root, RenderState);
+	}
+	RenderState->TreeBuildMS = 1000.0 * double(SDL_GetPerformanceCounter() - BuildStart) /
+		double(SDL_GetPerformanceFrequency());
+	printf("%s built !\n", BuilderName);
 
 #if 1
 	DEBUGOutputTreeGraphviz(Root, RenderState);
@@ -13,6 +13,7 @@ struct triangle
 	u32 MatIndex;
 };
 
+#define KD_TREE_NO_CHILD 0xFFFFFFFF
 struct kdtree
 {
 	u32 LeftIndex;
@@ -0,0 +1,361 @@
+#pragma once
+
+/* NOTE(hugo)
+ *    Linear BVH builder (Lauterbach et al. 2009, Karras 2012), for the
+ *    scenes that change too often to pay for BuildKdTree : the build
+ *    is a handful of passes over the triangles, split in tasks. Its
+ *    splits follow the Morton order, not a cost model, so the tree
+ *    is not as good as an SAH one could be.
+ *
+ *    1. Morton code of the isobarycenter of each triangle in the box
+ *       of the scene, 10 bits per axis (30 bits) or 21 (63 bits).
+ *    2. LSD radix sort of the codes, 8 bits per pass : each task
+ *       counts the digits of its range, then scatters them.
+ *    3. Hierarchy : Karras' internal node i finds on its own the range
+ *       of sorted triangles it covers and where it splits, so that all
+ *       the nodes are emitted at once.
+ *    4. Bounds, from the leaves up : of the two children of a node,
+ *       the last one done merges both boxes into it.
+ *    Every pass is cut in tasks for the worker pool.
+ *
+ *    The nodes are kdtree nodes, traversed as usual. The n - 1
+ *    internal nodes come first (the root being node 0) then the n
+ *    leaves, one per triangle. An internal node covering at most
+ *    LBVH_LEAF_TRIANGLE_COUNT triangles becomes a leaf : its subtree
+ *    stays in the pool but is never reached.
+ *
+ *    TODO(hugo): Treelet restructuring (Karras 2013) to bring
+ *    the tree closer to an SAH one.
+ */
+
+#define LBVH_LEAF_TRIANGLE_COUNT 4
+#define LBVH_MIN_ITEMS_PER_TASK 4096
+
+struct lbvh_build
+{
+	u32 TriangleCount;
+	u32 MortonBits;
+	rect3 SceneBox;
+	kdtree_build_buffer* Buffer;
+
+	// NOTE(hugo): Sort entries, and the ones of the other radix pass.
+	u64* Keys;
+	u32* Indices;
+	u64* TempKeys;
+	u32* TempIndices;
+	u32 Shift;
+	// NOTE(hugo): 256 digit counts, then offsets, per task.
+	u32* DigitOffsets;
+
+	triangle* Triangles;
+	triangle* SourceTriangles;
+	kdtree* Nodes;
+	// NOTE(hugo): Both children of each internal node, even the
+	// ones that became leaves, and the parent of every node.
+	u32* Children;
+	u32* Parents;
+	u32 volatile* Visits;
+};
+
+struct lbvh_task
+{
+	lbvh_build* Build;
+	u32 TaskIndex;
+	u32 First;
+	u32 OnePastLast;
+};
+
+inline u32
+CountLeadingZeros64(u64 Value)
+{
+	Assert(Value != 0);
+#ifdef _WIN32
+	unsigned long Index;
+	_BitScanReverse64(&Index, Value);
+	u32 Result = 63 - u32(Index);
+#else
+	u32 Result = u32(__builtin_clzll(Value));
+#endif
+	return(Result);
+}
+
+inline u32
+GetLBVHLeafNode(lbvh_build* Build, u32 SortedIndex)
+{
+	return(Build->TriangleCount - 1 + SortedIndex);
+}
+
+PLATFORM_WORK_QUEUE_CALLBACK(LBVHMortonCodes)
+{
+	lbvh_task* Task = (lbvh_task *)Data;
+	lbvh_build* Build = Task->Build;
+	kdtree_build_buffer* Buffer = Build->Buffer;
+	u32 BitsPerAxis = Build->MortonBits / 3;
+	float CellCount = float((1 << BitsPerAxis) - 1);
+	v3 Size = RectSize(Build->SceneBox);
+	v3 CellScale = V3(Size.x > 0.0f ? CellCount / Size.x : 0.0f,
+			Size.y > 0.0f ? CellCount / Size.y : 0.0f,
+			Size.z > 0.0f ? CellCount / Size.z : 0.0f);
+
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		u32 CellX = u32(Clamp(CellScale.x * (Buffer->Centroids[0][Index] - Build->SceneBox.Min.x), 0.0f, CellCount));
+		u32 CellY = u32(Clamp(CellScale.y * (Buffer->Centroids[1][Index] - Build->SceneBox.Min.y), 0.0f, CellCount));
+		u32 CellZ = u32(Clamp(CellScale.z * (Buffer->Centroids[2][Index] - Build->SceneBox.Min.z), 0.0f, CellCount));
+		Build->Keys[Index] = MortonIndex3(CellX, CellY, CellZ);
+		Build->Indices[Index] = Index;
+		Build->SourceTriangles[Index] = Build->Triangles[Index];
+		if(Index < Build->TriangleCount - 1)
+		{
+			Build->Visits[Index] = 0;
+		}
+	}
+}
+
+PLATFORM_WORK_QUEUE_CALLBACK(LBVHCountDigits)
+{
+	lbvh_task* Task = (lbvh_task *)Data;
+	lbvh_build* Build = Task->Build;
+	u32* Counts = Build->DigitOffsets + 256 * Task->TaskIndex;
+	for(u32 Digit = 0; Digit < 256; ++Digit)
+	{
+		Counts[Digit] = 0;
+	}
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		++Counts[(Build->Keys[Index] >> Build->Shift) & 0xFF];
+	}
+}
+
+// NOTE(hugo): Each task writes its entries of a digit after the ones
+// of the tasks before it, so that the sort is stable.
+PLATFORM_WORK_QUEUE_CALLBACK(LBVHScatterDigits)
+{
+	lbvh_task* Task = (lbvh_task *)Data;
+	lbvh_build* Build = Task->Build;
+	u32* Offsets = Build->DigitOffsets + 256 * Task->TaskIndex;
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		u32 Dest = Offsets[(Build->Keys[Index] >> Build->Shift) & 0xFF]++;
+		Build->TempKeys[Dest] = Build->Keys[Index];
+		Build->TempIndices[Dest] = Build->Indices[Index];
+	}
+}
+
+// NOTE(hugo): Length of the common prefix of two sorted keys, the
+// index breaking the ties so that all the keys are different. -1
+// out of the array.
+inline s32
+LBVHCommonPrefix(lbvh_build* Build, s32 A, s32 B)
+{
+	s32 Result = -1;
+	if(B >= 0 && B < s32(Build->TriangleCount))
+	{
+		u64 KeyA = Build->Keys[A];
+		u64 KeyB = Build->Keys[B];
+		if(KeyA != KeyB)
+		{
+			Result = s32(CountLeadingZeros64(KeyA ^ KeyB));
+		}
+		else
+		{
+			Result = 64 + s32(CountLeadingZeros64(u64(A ^ B)) - 32);
+		}
+	}
+	return(Result);
+}
+
+// NOTE(hugo): Internal nodes. Also puts the triangles in sorted order.
+PLATFORM_WORK_QUEUE_CALLBACK(LBVHEmitNodes)
+{
+	lbvh_task* Task = (lbvh_task *)Data;
+	lbvh_build* Build = Task->Build;
+
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		Build->Triangles[Index] = Build->SourceTriangles[Build->Indices[Index]];
+		if(Index == Build->TriangleCount - 1)
+		{
+			continue;
+		}
+
+		// NOTE(hugo): The range grows towards the neighbour
+		// sharing the longest prefix with this key.
+		s32 I = s32(Index);
+		s32 Direction = (LBVHCommonPrefix(Build, I, I + 1) > LBVHCommonPrefix(Build, I, I - 1)) ? 1 : -1;
+		s32 MinPrefix = LBVHCommonPrefix(Build, I, I - Direction);
+		s32 MaxLength = 2;
+		while(LBVHCommonPrefix(Build, I, I + MaxLength * Direction) > MinPrefix)
+		{
+			MaxLength *= 2;
+		}
+		s32 Length = 0;
+		for(s32 Step = MaxLength / 2; Step >= 1; Step /= 2)
+		{
+			if(LBVHCommonPrefix(Build, I, I + (Length + Step) * Direction) > MinPrefix)
+			{
+				Length += Step;
+			}
+		}
+		s32 J = I + Length * Direction;
+
+		// NOTE(hugo): The split is where the prefix of the range ends.
+		s32 NodePrefix = LBVHCommonPrefix(Build, I, J);
+		s32 Split = 0;
+		s32 Step = Length;
+		do
+		{
+			Step = (Step + 1) >> 1;
+			if(LBVHCommonPrefix(Build, I, I + (Split + Step) * Direction) > NodePrefix)
+			{
+				Split += Step;
+			}
+		} while(Step > 1);
+		s32 Gamma = I + Split * Direction + ((Direction < 0) ? -1 : 0);
+
+		u32 First = u32((I < J) ? I : J);
+		u32 Last = u32((I < J) ? J : I);
+		u32 Left = (First == u32(Gamma)) ? GetLBVHLeafNode(Build, u32(Gamma)) : u32(Gamma);
+		u32 Right = (Last == u32(Gamma + 1)) ? GetLBVHLeafNode(Build, u32(Gamma + 1)) : u32(Gamma + 1);
+		Build->Children[2 * Index + 0] = Left;
+		Build->Children[2 * Index + 1] = Right;
+		Build->Parents[Left] = Index;
+		Build->Parents[Right] = Index;
+
+		kdtree* Node = Build->Nodes + Index;
+		Node->LeftIndex = Left;
+		Node->RightIndex = Right;
+		Node->TriangleCount = 0;
+		Node->Triangles = 0;
+		if(Last - First + 1 <= LBVH_LEAF_TRIANGLE_COUNT)
+		{
+			Node->LeftIndex = KD_TREE_NO_CHILD;
+			Node->RightIndex = KD_TREE_NO_CHILD;
+			Node->TriangleCount = Last - First + 1;
+			Node->Triangles = Build->Triangles + First;
+		}
+	}
+}
+
+// NOTE(hugo): One task per range of leaves, each leaf going up as long
+// as it is the second child of its parent to be done.
+PLATFORM_WORK_QUEUE_CALLBACK(LBVHComputeBounds)
+{
+	lbvh_task* Task = (lbvh_task *)Data;
+	lbvh_build* Build = Task->Build;
+	kdtree_build_buffer* Buffer = Build->Buffer;
+
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		u32 NodeIndex = GetLBVHLeafNode(Build, Index);
+		kdtree* Leaf = Build->Nodes + NodeIndex;
+		v4 Min = Buffer->BoundsMin[Build->Indices[Index]];
+		v4 Max = Buffer->BoundsMax[Build->Indices[Index]];
+		Leaf->LeftIndex = KD_TREE_NO_CHILD;
+		Leaf->RightIndex = KD_TREE_NO_CHILD;
+		Leaf->TriangleCount = 1;
+		Leaf->Triangles = Build->Triangles + Index;
+		Leaf->BoundingBox = {Min.xyz, Max.xyz};
+
+		PropagateBoxesUp(Build->Nodes, NodeIndex, Build->Parents, Build->Children, Build->Visits, 0);
+	}
+}
+
+internal void
+RunLBVHPass(platform_work_queue* Queue, lbvh_task* Tasks, u32 TaskCount,
+		platform_work_queue_callback* Callback)
+{
+	platform_task_group Group = {};
+	for(u32 TaskIndex = 0; TaskIndex < TaskCount; ++TaskIndex)
+	{
+		SDLAddEntry(Queue, &Group, Callback, Tasks + TaskIndex);
+	}
+	SDLWaitForTaskGroup(Queue, &Group);
+}
+
+// NOTE(hugo): Root is the root of the loader, already holding every
+// triangle and the box of the scene. The temporary buffers live in
+// the render arena, the nodes are pushed right after the root.
+internal void
+BuildSceneLBVH(kdtree* Root, render_state* RenderState)
+{
+	u32 TriangleCount = Root->TriangleCount;
+	if(TriangleCount <= LBVH_LEAF_TRIANGLE_COUNT)
+	{
+		return;
+	}
+
+	memory_arena* Arena = &RenderState->Arena;
+	temporary_memory BuildMemory = BeginTemporaryMemory(Arena);
+	kdtree_build_buffer Buffer = CreateKdTreeBuildBuffer(Arena,
+			Root->Triangles, TriangleCount, RenderState->Vertices);
+
+	lbvh_build Build = {};
+	Build.TriangleCount = TriangleCount;
+	Build.MortonBits = RenderState->Config.MortonBits;
+	Build.SceneBox = Root->BoundingBox;
+	Build.Buffer = &Buffer;
+	Build.Keys = PushArray(Arena, TriangleCount, u64, Align(64, false));
+	Build.Indices = PushArray(Arena, TriangleCount, u32, Align(64, false));
+	Build.TempKeys = PushArray(Arena, TriangleCount, u64, Align(64, false));
+	Build.TempIndices = PushArray(Arena, TriangleCount, u32, Align(64, false));
+	Build.Triangles = Root->Triangles;
+	Build.SourceTriangles = PushArray(Arena, TriangleCount, triangle, Align(64, false));
+	Build.Children = PushArray(Arena, 2 * (TriangleCount - 1), u32, Align(64, false));
+	Build.Parents = PushArray(Arena, 2 * TriangleCount - 1, u32, Align(64, false));
+	Build.Visits = PushArray(Arena, TriangleCount - 1, u32, Align(64, false));
+
+	// NOTE(hugo): Node 0 is the root, already in the pool.
+	Assert(RenderState->TreeCount == 1 && Root == RenderState->Trees);
+	kdtree* OtherNodes = PushArray(&RenderState->SceneArena, 2 * TriangleCount - 2, kdtree);
+	Assert(OtherNodes == RenderState->Trees + 1);
+	RenderState->TreeCount = 2 * TriangleCount - 1;
+	Build.Nodes = RenderState->Trees;
+	Build.Parents[0] = KD_TREE_NO_CHILD;
+
+	platform_work_queue* Queue = &RenderState->Queue;
+	u32 TaskCount = (TriangleCount + LBVH_MIN_ITEMS_PER_TASK - 1) / LBVH_MIN_ITEMS_PER_TASK;
+	TaskCount = Maxu(1, Minu(TaskCount, 4 * Queue->DequeCount));
+	u32 ItemsPerTask = (TriangleCount + TaskCount - 1) / TaskCount;
+	lbvh_task* Tasks = PushArray(Arena, TaskCount, lbvh_task, Align(64, true));
+	for(u32 TaskIndex = 0; TaskIndex < TaskCount; ++TaskIndex)
+	{
+		lbvh_task* Task = Tasks + TaskIndex;
+		Task->Build = &Build;
+		Task->TaskIndex = TaskIndex;
+		Task->First = Minu(TriangleCount, TaskIndex * ItemsPerTask);
+		Task->OnePastLast = Minu(TriangleCount, Task->First + ItemsPerTask);
+	}
+	Build.DigitOffsets = PushArray(Arena, 256 * TaskCount, u32, Align(64, false));
+
+	RunLBVHPass(Queue, Tasks, TaskCount, LBVHMortonCodes);
+
+	for(Build.Shift = 0; Build.Shift < Build.MortonBits; Build.Shift += 8)
+	{
+		RunLBVHPass(Queue, Tasks, TaskCount, LBVHCountDigits);
+		u32 Total = 0;
+		for(u32 Digit = 0; Digit < 256; ++Digit)
+		{
+			for(u32 TaskIndex = 0; TaskIndex < TaskCount; ++TaskIndex)
+			{
+				u32* Offset = Build.DigitOffsets + 256 * TaskIndex + Digit;
+				u32 DigitCount = *Offset;
+				*Offset = Total;
+				Total += DigitCount;
+			}
+		}
+		RunLBVHPass(Queue, Tasks, TaskCount, LBVHScatterDigits);
+
+		u64* SwapKeys = Build.Keys;
+		Build.Keys = Build.TempKeys;
+		Build.TempKeys = SwapKeys;
+		u32* SwapIndices = Build.Indices;
+		Build.Indices = Build.TempIndices;
+		Build.TempIndices = SwapIndices;
+	}
+
+	RunLBVHPass(Queue, Tasks, TaskCount, LBVHEmitNodes);
+	RunLBVHPass(Queue, Tasks, TaskCount, LBVHComputeBounds);
+
+	EndTemporaryMemory(BuildMemory);
+}
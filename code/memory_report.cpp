@@ -0,0 +1,70 @@
+#pragma once
+
+// NOTE(hugo): What the arena memory goes to. Each subsystem sets the
+// tag of the arena before it pushes (SetArenaTag), and the report
+// sums the tags over every arena, also per triangle of the scene so
+// that a change in the size of a vertex or a node shows right away.
+
+enum memory_tag
+{
+	MemoryTag_Other,
+	MemoryTag_Vertices,
+	MemoryTag_Triangles,
+	MemoryTag_TreeNodes,
+	MemoryTag_Spheres,
+	MemoryTag_Materials,
+	MemoryTag_Tiles,
+	MemoryTag_Framebuffers,
+	MemoryTag_PassBuffers,
+	MemoryTag_Wavefront,
+	MemoryTag_Scheduler,
+	MemoryTag_Stats,
+	MemoryTag_Trace,
+
+	MemoryTag_Count,
+};
+
+global_variable char* MemoryTagNames[MemoryTag_Count] =
+{
+	"other", "vertices", "triangles", "tree nodes", "spheres", "materials",
+	"tiles", "framebuffers", "pass buffers", "wavefront", "scheduler", "stats", "trace",
+};
+
+internal void
+PrintMemoryReport(char* Label, memory_arena** Arenas, char** ArenaNames, u32 ArenaCount, u32 TriangleCount)
+{
+	Assert(MemoryTag_Count <= ARENA_TAG_COUNT);
+	memory_index TaggedSize[MemoryTag_Count] = {};
+	memory_index TotalSize = 0;
+	for(u32 ArenaIndex = 0; ArenaIndex < ArenaCount; ++ArenaIndex)
+	{
+		for(u32 Tag = 0; Tag < MemoryTag_Count; ++Tag)
+		{
+			TaggedSize[Tag] += Arenas[ArenaIndex]->TaggedSize[Tag];
+			TotalSize += Arenas[ArenaIndex]->TaggedSize[Tag];
+		}
+	}
+
+	printf("Memory %s (%u triangles) :\n", Label, TriangleCount);
+	printf("\t%-14s %12s %14s\n", "subsystem", "KB", "bytes/triangle");
+	for(u32 Tag = 0; Tag < MemoryTag_Count; ++Tag)
+	{
+		if(TaggedSize[Tag] > 0)
+		{
+			printf("\t%-14s %12.1f %14.1f\n", MemoryTagNames[Tag], double(TaggedSize[Tag]) / double(Kilobytes(1)),
+					(TriangleCount > 0) ? double(TaggedSize[Tag]) / double(TriangleCount) : 0.0);
+		}
+	}
+	printf("\t%-14s %12.1f %14.1f\n", "total", double(TotalSize) / double(Kilobytes(1)),
+			(TriangleCount > 0) ? double(TotalSize) / double(TriangleCount) : 0.0);
+
+	for(u32 ArenaIndex = 0; ArenaIndex < ArenaCount; ++ArenaIndex)
+	{
+		PrintArenaUsage(ArenaNames[ArenaIndex], Arenas[ArenaIndex]);
+	}
+	// NOTE(hugo): Every arena, the scratch ones of the workers too.
+	printf("\t%.1fMB committed by the arenas, of a %.1fMB budget%s\n",
+			double(GlobalArenaCommitted) / double(Megabytes(1)),
+			double(GlobalArenaMemoryBudget) / double(Megabytes(1)),
+			IsArenaMemoryNearlyFull() ? " (nearly full !)" : "");
+}
@@ -4,29 +4,92 @@ struct platform_work_queue;
 #define PLATFORM_WORK_QUEUE_CALLBACK(name) void name(platform_work_queue *Queue, void *Data)
 typedef PLATFORM_WORK_QUEUE_CALLBACK(platform_work_queue_callback);
 
+// NOTE(hugo): A task group counts the tasks submitted to it that are
+// not finished yet. Waiting on a group makes the waiting thread run
+// tasks (of any group) until the count reaches zero.
+struct platform_task_group
+{
+    u32 volatile PendingCount;
+};
+
 struct platform_work_queue_entry
 {
     platform_work_queue_callback *Callback;
     void *Data;
+    platform_task_group *Group;
+};
+
+// NOTE(hugo): One deque per thread (the main thread owns deque 0).
+// The owner pushes and pops at the bottom, the other threads steal
+// the oldest entries at the top. The deque grows when full so there
+// is no limit on the number of submitted tasks. Each deque sits on
+// its own cache line so threads working on their own deque do not
+// disturb each other.
+#define WORK_DEQUE_INITIAL_CAPACITY 256
+struct work_deque
+{
+    SDL_SpinLock Lock;
+    u32 Top;
+    u32 Bottom;
+    u32 Capacity;
+    platform_work_queue_entry *Entries;
+
+    u8 Pad[64 - 3 * sizeof(u32) - sizeof(SDL_SpinLock) - sizeof(platform_work_queue_entry *)];
+};
+
+// NOTE(hugo): Each thread owns a scratch arena, deque 0's being the
+// main thread's since it runs tasks while it waits. Only its owner
+// pushes to it, so tasks can allocate without locks : take it with
+// GetThreadScratch and put it back as it was with a temporary memory.
+// The arena only reserves address space, and the owner is the first
+// to write to its pages so that, with the first-touch policy, they
+// end up on the NUMA node of the thread. Each sits on its own cache
+// line since the owner bumps Used all the time.
+#define THREAD_SCRATCH_SIZE Megabytes(64)
+struct alignas(64) thread_scratch
+{
+    memory_arena Arena;
 };
 
 struct platform_work_queue
 {
-    u32 volatile CompletionGoal;
-    u32 volatile CompletionCount;
+    u32 DequeCount;
+    work_deque *Deques;
+    // NOTE(hugo): One per deque.
+    thread_scratch *Scratches;
+    u32 volatile NextDequeToFill;
 
-    u32 volatile NextEntryToWrite;
-    u32 volatile NextEntryToRead;
     SDL_sem *SemaphoreHandle;
 
-    platform_work_queue_entry Entries[256];
+    u32 volatile StartedThreadCount;
+    // NOTE(hugo): Set by SDLStopQueue, the workers leave their loop
+    // and count themselves out before main returns.
+    b32 volatile Stopping;
+    u32 volatile StoppedThreadCount;
+
+    platform_task_group DefaultGroup;
 };
 
 struct sdl_thread_startup
 {
     platform_work_queue *Queue;
+    u32 DequeIndex;
+    s32 PinnedCPU;
 };
 
+// NOTE(hugo): Index of the deque owned by the calling thread,
+// 0 being the main thread.
+global_variable thread_local u32 GlobalThreadDequeIndex = 0;
+global_variable thread_local u32 GlobalThreadStealSeed = 0;
+global_variable thread_local memory_arena* GlobalThreadScratch = 0;
+
+inline memory_arena*
+GetThreadScratch(void)
+{
+	Assert(GlobalThreadScratch);
+	return(GlobalThreadScratch);
+}
+
 #ifdef _WIN32
 #include <intrin.h>
 #define CompletePreviousReadsBeforeFutureReads _ReadBarrier()
@@ -47,58 +110,153 @@ inline u32 AtomicCompareExchangeU32(u32 volatile* Value, u32 New, u32 Expected)
 }
 #endif
 
+internal void
+PushDequeBottom(work_deque* Deque, platform_work_queue_entry Entry)
+{
+	SDL_AtomicLock(&Deque->Lock);
+	if(Deque->Bottom - Deque->Top == Deque->Capacity)
+	{
+		// NOTE(hugo): Full : double the capacity, keeping the
+		// entries at the same logical index.
+		u32 NewCapacity = 2 * Deque->Capacity;
+		platform_work_queue_entry* NewEntries = AllocateArray(platform_work_queue_entry, NewCapacity);
+		for(u32 Index = Deque->Top; Index != Deque->Bottom; ++Index)
+		{
+			NewEntries[Index & (NewCapacity - 1)] = Deque->Entries[Index & (Deque->Capacity - 1)];
+		}
+		Free(Deque->Entries);
+		Deque->Entries = NewEntries;
+		Deque->Capacity = NewCapacity;
+	}
+	Deque->Entries[Deque->Bottom & (Deque->Capacity - 1)] = Entry;
+	++Deque->Bottom;
+	SDL_AtomicUnlock(&Deque->Lock);
+}
+
+internal bool
+PopDequeBottom(work_deque* Deque, platform_work_queue_entry* Entry)
+{
+	bool Found = false;
+	SDL_AtomicLock(&Deque->Lock);
+	if(Deque->Bottom != Deque->Top)
+	{
+		--Deque->Bottom;
+		*Entry = Deque->Entries[Deque->Bottom & (Deque->Capacity - 1)];
+		Found = true;
+	}
+	SDL_AtomicUnlock(&Deque->Lock);
+	return(Found);
+}
+
+internal bool
+StealDequeTop(work_deque* Deque, platform_work_queue_entry* Entry)
+{
+	// NOTE(hugo): Peek without the lock first so that idle thieves
+	// do not keep bouncing the cache line of empty deques.
+	if(*(u32 volatile *)&Deque->Bottom == *(u32 volatile *)&Deque->Top)
+	{
+		return(false);
+	}
+
+	bool Found = false;
+	SDL_AtomicLock(&Deque->Lock);
+	if(Deque->Bottom != Deque->Top)
+	{
+		*Entry = Deque->Entries[Deque->Top & (Deque->Capacity - 1)];
+		++Deque->Top;
+		Found = true;
+	}
+	SDL_AtomicUnlock(&Deque->Lock);
+	return(Found);
+}
 
-// TODO(hugo) : Is it accurate to say that 
-// only the main thread can use this function ?
 internal void
-SDLAddEntry(platform_work_queue* Queue, platform_work_queue_callback* Callback, void* Data)
+SDLAddEntry(platform_work_queue* Queue, platform_task_group* Group,
+		platform_work_queue_callback* Callback, void* Data)
 {
-	u32 NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % ArrayCount(Queue->Entries);
-	Assert(NewNextEntryToWrite != Queue->NextEntryToRead);
-	platform_work_queue_entry* Entry = Queue->Entries + Queue->NextEntryToWrite;
-	Entry->Callback = Callback;
-	Entry->Data = Data;
-	++Queue->CompletionGoal;
-	SDL_CompilerBarrier();
-	Queue->NextEntryToWrite = NewNextEntryToWrite;
+	platform_work_queue_entry Entry = {};
+	Entry.Callback = Callback;
+	Entry.Data = Data;
+	Entry.Group = Group;
+	SDL_AtomicIncRef((SDL_atomic_t *)&Group->PendingCount);
+
+	// NOTE(hugo): Tasks submitted from the main thread are dealt
+	// to every deque so that each worker finds work right away.
+	// Tasks submitted from a worker stay on its own deque.
+	u32 DequeIndex = GlobalThreadDequeIndex;
+	if(DequeIndex == 0)
+	{
+		DequeIndex = Queue->NextDequeToFill;
+		Queue->NextDequeToFill = (DequeIndex + 1) % Queue->DequeCount;
+	}
+	PushDequeBottom(Queue->Deques + DequeIndex, Entry);
+
 	SDL_SemPost(Queue->SemaphoreHandle);
 }
 
+internal void
+SDLAddEntry(platform_work_queue* Queue, platform_work_queue_callback* Callback, void* Data)
+{
+	SDLAddEntry(Queue, &Queue->DefaultGroup, Callback, Data);
+}
+
 internal bool
 SDLDoNextWorkQueueEntry(platform_work_queue* Queue)
 {
-	bool WeShouldSleep = false;
-	u32 OriginalNextEntryToRead = Queue->NextEntryToRead;
-	u32 NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
-	if(OriginalNextEntryToRead != Queue->NextEntryToWrite)
+	u32 OwnIndex = GlobalThreadDequeIndex;
+	platform_work_queue_entry Entry = {};
+	bool Found = PopDequeBottom(Queue->Deques + OwnIndex, &Entry);
+	bool Stolen = false;
+
+	if(!Found)
 	{
-		SDL_bool WasSet = SDL_AtomicCAS((SDL_atomic_t *)&Queue->NextEntryToRead,
-				OriginalNextEntryToRead, NewNextEntryToRead);
-		if(WasSet)
+		// NOTE(hugo): Steal, starting from a random victim so
+		// that thieves do not all hit the same deque.
+		u32 Seed = GlobalThreadStealSeed;
+		Seed ^= Seed << 13;
+		Seed ^= Seed >> 17;
+		Seed ^= Seed << 5;
+		GlobalThreadStealSeed = Seed;
+
+		u32 FirstVictim = Seed % Queue->DequeCount;
+		for(u32 Offset = 0; !Found && (Offset < Queue->DequeCount); ++Offset)
 		{
-			platform_work_queue_entry Entry = Queue->Entries[OriginalNextEntryToRead];
-			Entry.Callback(Queue, Entry.Data);
-			SDL_AtomicIncRef((SDL_atomic_t *)&Queue->CompletionCount);
+			u32 VictimIndex = (FirstVictim + Offset) % Queue->DequeCount;
+			if(VictimIndex != OwnIndex)
+			{
+				Found = StealDequeTop(Queue->Deques + VictimIndex, &Entry);
+			}
 		}
+		Stolen = Found;
 	}
-	else
+
+	if(Found)
 	{
-		WeShouldSleep = true;
+		task_trace_event TraceEvent = {};
+		task_trace_event* OuterTraceEvent = BeginTaskTrace(&TraceEvent, Stolen);
+		Entry.Callback(Queue, Entry.Data);
+		EndTaskTrace(OwnIndex, &TraceEvent, OuterTraceEvent);
+		SDL_CompilerBarrier();
+		SDL_AtomicAdd((SDL_atomic_t *)&Entry.Group->PendingCount, -1);
 	}
 
+	bool WeShouldSleep = !Found;
 	return(WeShouldSleep);
 }
 
 internal void
-SDLCompleteAllWork(platform_work_queue* Queue)
+SDLWaitForTaskGroup(platform_work_queue* Queue, platform_task_group* Group)
 {
-	while(Queue->CompletionGoal != Queue->CompletionCount)
+	while(*(u32 volatile *)&Group->PendingCount != 0)
 	{
 		SDLDoNextWorkQueueEntry(Queue);
 	}
+}
 
-	Queue->CompletionGoal = 0;
-	Queue->CompletionCount = 0;
+internal void
+SDLCompleteAllWork(platform_work_queue* Queue)
+{
+	SDLWaitForTaskGroup(Queue, &Queue->DefaultGroup);
 }
 
 int
@@ -106,8 +264,19 @@ ThreadProc(void* Parameter)
 {
 	sdl_thread_startup* Thread = (sdl_thread_startup *)Parameter;
 	platform_work_queue* Queue = Thread->Queue;
+	GlobalThreadDequeIndex = Thread->DequeIndex;
+	GlobalThreadStealSeed = 0x9E3779B9 * (Thread->DequeIndex + 1);
 
-	for(;;)
+	if(Thread->PinnedCPU >= 0 && !PinCurrentThreadToCPU(Thread->PinnedCPU))
+	{
+		printf("Could not pin a worker to CPU %d.\n", Thread->PinnedCPU);
+	}
+	// NOTE(hugo): Once pinned, see thread_scratch.
+	GlobalThreadScratch = &Queue->Scratches[Thread->DequeIndex].Arena;
+	InitialiseVirtualArena(GlobalThreadScratch, THREAD_SCRATCH_SIZE);
+	SDL_AtomicIncRef((SDL_atomic_t *)&Queue->StartedThreadCount);
+
+	while(!Queue->Stopping)
 	{
 		if(SDLDoNextWorkQueueEntry(Queue))
 		{
@@ -115,24 +284,35 @@ ThreadProc(void* Parameter)
 		}
 	}
 
-#ifndef _WIN32
-	// NOTE(hugo) : Triggers a "Unreachable code" warning
-	// on MSVC
+	SDL_AtomicIncRef((SDL_atomic_t *)&Queue->StoppedThreadCount);
 	return(0);
-#endif
 }
 
 internal void
-SDLMakeQueue(platform_work_queue* Queue, u32 ThreadCount, sdl_thread_startup* Startups)
+SDLMakeQueue(platform_work_queue* Queue, u32 ThreadCount, sdl_thread_startup* Startups, memory_arena* Arena)
 {
-    Queue->CompletionGoal = 0;
-    Queue->CompletionCount = 0;
+    Queue->DequeCount = ThreadCount + 1;
+    Queue->Deques = PushArray(Arena, Queue->DequeCount, work_deque, Align(64, true));
+    for(u32 DequeIndex = 0; DequeIndex < Queue->DequeCount; ++DequeIndex)
+    {
+        work_deque *Deque = Queue->Deques + DequeIndex;
+        Deque->Capacity = WORK_DEQUE_INITIAL_CAPACITY;
+        Deque->Entries = AllocateArray(platform_work_queue_entry, Deque->Capacity);
+    }
+    Queue->Scratches = PushArray(Arena, Queue->DequeCount, thread_scratch, Align(64, true));
+    Queue->NextDequeToFill = 0;
+    Queue->DefaultGroup.PendingCount = 0;
 
-    Queue->NextEntryToWrite = 0;
-    Queue->NextEntryToRead = 0;
+    GlobalThreadDequeIndex = 0;
+    GlobalThreadStealSeed = 0x9E3779B9;
+    GlobalThreadScratch = &Queue->Scratches[0].Arena;
+    InitialiseVirtualArena(GlobalThreadScratch, THREAD_SCRATCH_SIZE);
 
     u32 InitialCount = 0;
     Queue->SemaphoreHandle = SDL_CreateSemaphore(InitialCount);
+    Queue->StartedThreadCount = 0;
+    Queue->Stopping = false;
+    Queue->StoppedThreadCount = 0;
 
     for(u32 ThreadIndex = 0;
         ThreadIndex < ThreadCount;
@@ -140,9 +320,38 @@ SDLMakeQueue(platform_work_queue* Queue, u32 ThreadCount, sdl_thread_startup* St
     {
         sdl_thread_startup *Startup = Startups + ThreadIndex;
         Startup->Queue = Queue;
+        Startup->DequeIndex = ThreadIndex + 1;
 
         SDL_Thread *ThreadHandle = SDL_CreateThread(ThreadProc, 0, Startup);
         SDL_DetachThread(ThreadHandle);
     }
+
+    // NOTE(hugo): Wait for every worker to be pinned and to have set
+    // up its scratch arena, once pinned, before any timing starts.
+    // Nothing of the arena is touched yet, its pages come with the
+    // first pushes of the worker.
+    while(Queue->StartedThreadCount != ThreadCount)
+    {
+        SDL_Delay(1);
+    }
 }
 
+// NOTE(hugo): Parks the workers for good before main returns : the queue
+// lives in its stack frame, and the semaphore can still hold posts of
+// task groups done long ago that would wake them on it. Every group
+// must have been waited for.
+internal void
+SDLStopQueue(platform_work_queue* Queue)
+{
+    u32 ThreadCount = Queue->DequeCount - 1;
+    Queue->Stopping = true;
+    SDL_CompilerBarrier();
+    for(u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ++ThreadIndex)
+    {
+        SDL_SemPost(Queue->SemaphoreHandle);
+    }
+    while(Queue->StoppedThreadCount != ThreadCount)
+    {
+        SDL_Delay(1);
+    }
+}
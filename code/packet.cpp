@@ -0,0 +1,397 @@
+#pragma once
+
+// NOTE(hugo): Packet tracing of camera rays. The rays of a square of
+// PacketSize x PacketSize pixels are traced together through the tree :
+// - the whole packet is first tested against the node with interval
+//   arithmetic on the frustum of the packet (the rays share the camera
+//   origin), which culls the node for every ray at once,
+// - otherwise groups of rays are tested against the node and its
+//   triangles, one ray per lane : 4 with SSE, 8 when built with AVX.
+// Once the closest hits are known, each ray goes on with ShadeRayHit
+// exactly as if ShootRay had found the hit.
+
+#define MAX_PACKET_SIZE 8
+#define MAX_PACKET_RAY_COUNT (MAX_PACKET_SIZE * MAX_PACKET_SIZE)
+
+#if RAY_SSE
+#if RAY_AVX
+#define PACKET_GROUP_WIDTH 8
+typedef f32x8 group_f32;
+typedef v3x8 group_v3;
+typedef mask8 group_mask;
+inline group_f32 GroupF32(float A) {return(F32x8(A));}
+inline group_f32 LoadGroupF32(float* Source) {return(LoadF32x8(Source));}
+inline group_v3 GroupV3(v3 A) {return(V3x8(A));}
+#else
+#define PACKET_GROUP_WIDTH 4
+typedef f32x4 group_f32;
+typedef v3x4 group_v3;
+typedef mask4 group_mask;
+inline group_f32 GroupF32(float A) {return(F32x4(A));}
+inline group_f32 LoadGroupF32(float* Source) {return(LoadF32x4(Source));}
+inline group_v3 GroupV3(v3 A) {return(V3x4(A));}
+#endif
+#define MAX_PACKET_GROUP_COUNT (MAX_PACKET_RAY_COUNT / PACKET_GROUP_WIDTH)
+
+struct ray_packet
+{
+	u32 GroupCount;
+
+	group_v3 Origins[MAX_PACKET_GROUP_COUNT];
+	group_v3 Dirs[MAX_PACKET_GROUP_COUNT];
+	group_v3 InvDirs[MAX_PACKET_GROUP_COUNT];
+
+	// NOTE(hugo): Closest hit so far, and its barycentric coordinates.
+	// Unused lanes have a negative t so that they never hit anything.
+	group_f32 t[MAX_PACKET_GROUP_COUNT];
+	group_f32 U[MAX_PACKET_GROUP_COUNT];
+	group_f32 V[MAX_PACKET_GROUP_COUNT];
+	triangle* HitTriangle[MAX_PACKET_RAY_COUNT];
+
+	// NOTE(hugo): Frustum of the packet. The interval test is only
+	// done on the axes where every direction has the same sign.
+	v3 Origin;
+	v3 DirMin;
+	v3 DirMax;
+	bool UsableAxis[3];
+};
+
+internal void
+InitialisePacket(ray_packet* Packet, ray* Rays, bool* Valid, u32 RayCount)
+{
+	Assert(RayCount % PACKET_GROUP_WIDTH == 0 && RayCount <= MAX_PACKET_RAY_COUNT);
+	Packet->GroupCount = RayCount / PACKET_GROUP_WIDTH;
+
+	bool FirstRay = true;
+	for(u32 RayIndex = 0; RayIndex < RayCount; ++RayIndex)
+	{
+		Packet->HitTriangle[RayIndex] = 0;
+		if(Valid[RayIndex])
+		{
+			v3 Dir = Rays[RayIndex].Dir;
+			if(FirstRay)
+			{
+				Packet->Origin = Rays[RayIndex].Start;
+				Packet->DirMin = Dir;
+				Packet->DirMax = Dir;
+				FirstRay = false;
+			}
+			for(u32 Axis = 0; Axis < 3; ++Axis)
+			{
+				Packet->DirMin.E[Axis] = Minf(Packet->DirMin.E[Axis], Dir.E[Axis]);
+				Packet->DirMax.E[Axis] = Maxf(Packet->DirMax.E[Axis], Dir.E[Axis]);
+			}
+		}
+	}
+	for(u32 Axis = 0; Axis < 3; ++Axis)
+	{
+		Packet->UsableAxis[Axis] = !FirstRay &&
+			((Packet->DirMin.E[Axis] > 0.0f) || (Packet->DirMax.E[Axis] < 0.0f));
+	}
+
+	for(u32 GroupIndex = 0; GroupIndex < Packet->GroupCount; ++GroupIndex)
+	{
+		ray* R = Rays + PACKET_GROUP_WIDTH * GroupIndex;
+		bool* G = Valid + PACKET_GROUP_WIDTH * GroupIndex;
+		float Lanes[7][PACKET_GROUP_WIDTH];
+		for(u32 Lane = 0; Lane < PACKET_GROUP_WIDTH; ++Lane)
+		{
+			for(u32 Axis = 0; Axis < 3; ++Axis)
+			{
+				Lanes[Axis][Lane] = R[Lane].Start.E[Axis];
+				Lanes[3 + Axis][Lane] = R[Lane].Dir.E[Axis];
+			}
+			Lanes[6][Lane] = G[Lane] ? MAX_FLOAT32 : -1.0f;
+		}
+		group_v3 Dir = {LoadGroupF32(Lanes[3]), LoadGroupF32(Lanes[4]), LoadGroupF32(Lanes[5])};
+		group_f32 One = GroupF32(1.0f);
+		Packet->Origins[GroupIndex] = {LoadGroupF32(Lanes[0]), LoadGroupF32(Lanes[1]), LoadGroupF32(Lanes[2])};
+		Packet->Dirs[GroupIndex] = Dir;
+		Packet->InvDirs[GroupIndex] = {One / Dir.x, One / Dir.y, One / Dir.z};
+		Packet->t[GroupIndex] = LoadGroupF32(Lanes[6]);
+		Packet->U[GroupIndex] = GroupF32(0.0f);
+		Packet->V[GroupIndex] = GroupF32(0.0f);
+	}
+}
+
+// NOTE(hugo): Conservative : false only if no ray of the packet can
+// hit the box. For each usable axis the entry and exit distances of
+// every ray lie in an interval given by the extreme directions.
+internal bool
+PacketFrustumMayHitBox(ray_packet* Packet, rect3 Box)
+{
+	float LatestEntry = 0.0f;
+	float EarliestExit = MAX_FLOAT32;
+	for(u32 Axis = 0; Axis < 3; ++Axis)
+	{
+		if(Packet->UsableAxis[Axis])
+		{
+			float Near = Box.Min.E[Axis] - Packet->Origin.E[Axis];
+			float Far = Box.Max.E[Axis] - Packet->Origin.E[Axis];
+			if(Packet->DirMin.E[Axis] < 0.0f)
+			{
+				float Temp = Near;
+				Near = Far;
+				Far = Temp;
+			}
+			float DirMin = Packet->DirMin.E[Axis];
+			float DirMax = Packet->DirMax.E[Axis];
+			float EntryLow = Minf(Near / DirMin, Near / DirMax);
+			float ExitHigh = Maxf(Far / DirMin, Far / DirMax);
+			LatestEntry = Maxf(LatestEntry, EntryLow);
+			EarliestExit = Minf(EarliestExit, ExitHigh);
+		}
+	}
+	return(LatestEntry <= EarliestExit);
+}
+
+// NOTE(hugo): Slab test of a group of rays, limited to [0, closest hit].
+inline group_mask
+GroupHitBox(ray_packet* Packet, u32 GroupIndex, rect3 Box)
+{
+	group_v3 Origin = Packet->Origins[GroupIndex];
+	group_v3 T0 = Hadamard(GroupV3(Box.Min) - Origin, Packet->InvDirs[GroupIndex]);
+	group_v3 T1 = Hadamard(GroupV3(Box.Max) - Origin, Packet->InvDirs[GroupIndex]);
+	group_v3 Near = Minf(T0, T1);
+	group_v3 Far = Maxf(T0, T1);
+
+	group_f32 Enter = Maxf(Maxf(Maxf(GroupF32(0.0f), Near.x), Near.y), Near.z);
+	group_f32 Exit = Minf(Minf(Minf(Packet->t[GroupIndex], Far.x), Far.y), Far.z);
+	return(Enter <= Exit);
+}
+
+// NOTE(hugo): Same test as RayTriangleIntersection, on a group of rays.
+internal void
+GroupTriangleIntersection(ray_packet* Packet, u32 GroupIndex, triangle* T, vertex* Vertices)
+{
+	v3 v0 = Vertices[T->Indices[0]].P;
+	v3 v1 = Vertices[T->Indices[1]].P;
+	v3 v2 = Vertices[T->Indices[2]].P;
+	v3 e1 = v1 - v0;
+	v3 e2 = v2 - v0;
+	// NOTE(hugo): Only used for its sign against the rays.
+	v3 TriangleNormal = Cross(e1, e2);
+
+	group_v3 D = Packet->Dirs[GroupIndex];
+	group_v3 E1 = GroupV3(e1);
+	group_v3 E2 = GroupV3(e2);
+	group_f32 Zero = GroupF32(0.0f);
+
+	// NOTE(hugo): Backface or parallel
+	group_mask Mask = (Dot(GroupV3(TriangleNormal), D) < Zero);
+
+	group_v3 Q = Cross(D, E2);
+	group_f32 A = Dot(Q, E1);
+	Mask = Mask & (A != Zero);
+	if(!AnyLane(Mask))
+	{
+		return;
+	}
+
+	group_f32 InvA = GroupF32(1.0f) / A;
+	group_v3 S = InvA * (Packet->Origins[GroupIndex] - GroupV3(v0));
+	group_v3 R = Cross(S, E1);
+
+	group_f32 U = Dot(Q, S);
+	group_f32 V = Dot(R, D);
+	group_f32 W = (GroupF32(1.0f) - U) - V;
+	Mask = Mask & (U >= Zero) & (V >= Zero) & (W >= Zero);
+
+	group_f32 t = Dot(E2, R);
+	Mask = Mask & (t >= Zero) & (t < Packet->t[GroupIndex]);
+
+	u32 HitLanes = MaskBits(Mask);
+	if(HitLanes)
+	{
+		Packet->t[GroupIndex] = Select(Mask, Packet->t[GroupIndex], t);
+		Packet->U[GroupIndex] = Select(Mask, Packet->U[GroupIndex], U);
+		Packet->V[GroupIndex] = Select(Mask, Packet->V[GroupIndex], V);
+		for(u32 Lane = 0; Lane < PACKET_GROUP_WIDTH; ++Lane)
+		{
+			if(HitLanes & (1 << Lane))
+			{
+				Packet->HitTriangle[PACKET_GROUP_WIDTH * GroupIndex + Lane] = T;
+				TRAVERSAL_STAT_ADD(Hits, 1);
+			}
+		}
+	}
+}
+
+internal void
+PacketKdTreeIntersection(ray_packet* Packet, kdtree* Node, render_state* RenderState)
+{
+	if(!PacketFrustumMayHitBox(Packet, Node->BoundingBox))
+	{
+		return;
+	}
+
+	u32 ActiveGroupCount = 0;
+	u8 ActiveGroups[MAX_PACKET_GROUP_COUNT];
+	for(u32 GroupIndex = 0; GroupIndex < Packet->GroupCount; ++GroupIndex)
+	{
+		if(AnyLane(GroupHitBox(Packet, GroupIndex, Node->BoundingBox)))
+		{
+			ActiveGroups[ActiveGroupCount++] = u8(GroupIndex);
+		}
+	}
+	TRAVERSAL_STAT_ADD(BoxesTested, PACKET_GROUP_WIDTH * Packet->GroupCount);
+	if(ActiveGroupCount == 0)
+	{
+		return;
+	}
+	TRAVERSAL_STAT_ADD(NodesVisited, PACKET_GROUP_WIDTH * ActiveGroupCount);
+	TRAVERSAL_STAT_ADD(TrianglesTested, PACKET_GROUP_WIDTH * ActiveGroupCount * Node->TriangleCount);
+
+	kdtree* Left = GetKDTreeFromPool(Node->LeftIndex, RenderState);
+	if(Left)
+	{
+		PacketKdTreeIntersection(Packet, Left, RenderState);
+	}
+	kdtree* Right = GetKDTreeFromPool(Node->RightIndex, RenderState);
+	if(Right)
+	{
+		PacketKdTreeIntersection(Packet, Right, RenderState);
+	}
+
+	for(u32 TriangleIndex = 0; TriangleIndex < Node->TriangleCount; ++TriangleIndex)
+	{
+		triangle* T = Node->Triangles + TriangleIndex;
+		for(u32 ActiveIndex = 0; ActiveIndex < ActiveGroupCount; ++ActiveIndex)
+		{
+			GroupTriangleIntersection(Packet, ActiveGroups[ActiveIndex], T, RenderState->Vertices);
+		}
+	}
+}
+
+// NOTE(hugo): Builds the hit record of a ray of the packet as
+// RayTriangleIntersection would have.
+internal hit_record
+GetPacketHitRecord(ray_packet* Packet, u32 RayIndex, ray Ray, vertex* Vertices)
+{
+	hit_record Result = {};
+	Result.t = MAX_FLOAT32;
+	triangle* T = Packet->HitTriangle[RayIndex];
+	if(T)
+	{
+		u32 GroupIndex = RayIndex / PACKET_GROUP_WIDTH;
+		u32 Lane = RayIndex % PACKET_GROUP_WIDTH;
+		float t = GetLane(Packet->t[GroupIndex], Lane);
+		float U = GetLane(Packet->U[GroupIndex], Lane);
+		float V = GetLane(Packet->V[GroupIndex], Lane);
+		float W = 1.0f - U - V;
+
+		Result.t = t;
+		Result.P = Ray.Start + t * Ray.Dir;
+		v3 n0 = Vertices[T->Indices[0]].N;
+		v3 n1 = Vertices[T->Indices[1]].N;
+		v3 n2 = Vertices[T->Indices[2]].N;
+		Result.N = NormalizedFast(U * n0 + V * n1 + W * n2);
+		Result.MaterialIndex = T->MatIndex;
+	}
+	return(Result);
+}
+
+// NOTE(hugo): Packet version of the loops of ShootRayChunk. For
+// every sample, the rays of each square of the tile are generated
+// then traced together. Returns the number of rays shot.
+internal u32
+RenderTilePackets(shoot_ray_block_data* ShootRayChunkData, random_series* Entropy)
+{
+	render_state* RenderState = ShootRayChunkData->RenderState;
+	u32 PacketSize = RenderState->Config.PacketSize;
+	bool PrimaryOnly = RenderState->Config.PrimaryOnly;
+	u32 Pitch = RenderState->Config.Width;
+	u32 StartX = ShootRayChunkData->ChunkStartX;
+	u32 EndX = StartX + ShootRayChunkData->ChunkWidth;
+	u32 StartY = ShootRayChunkData->ChunkStartY;
+	u32 EndY = StartY + ShootRayChunkData->ChunkHeight;
+	u32 RayCount = 0;
+
+	// NOTE(hugo): The packet and its rays live in the scratch of the
+	// thread, on cache lines of their own, for the whole tile.
+	memory_arena* Scratch = GetThreadScratch();
+	temporary_memory ScratchMemory = BeginTemporaryMemory(Scratch);
+	u32 PacketRayCount = PacketSize * PacketSize;
+	ray_packet* Packet = PushStruct(Scratch, ray_packet, Align(64, false));
+	ray* Rays = PushArray(Scratch, PacketRayCount, ray, Align(64, false));
+	bool* Valid = PushArray(Scratch, PacketRayCount, bool, Align(64, false));
+	v3* SampleSums = PushArray(Scratch, PacketRayCount, v3, Align(64, false));
+
+	for(u32 PacketY = StartY; PacketY < EndY; PacketY += PacketSize)
+	{
+		for(u32 PacketX = StartX; PacketX < EndX; PacketX += PacketSize)
+		{
+			for(u32 RayIndex = 0; RayIndex < PacketRayCount; ++RayIndex)
+			{
+				SampleSums[RayIndex] = {};
+			}
+
+			for(u32 SampleIndex = 0; SampleIndex < ShootRayChunkData->SampleCount; ++SampleIndex)
+			{
+				u32 ValidCount = 0;
+				{
+					TIMED_BLOCK_COUNTED(Generate, PacketRayCount);
+					for(u32 RayIndex = 0; RayIndex < PacketRayCount; ++RayIndex)
+					{
+						u32 X = PacketX + RayIndex % PacketSize;
+						u32 Y = PacketY + RayIndex / PacketSize;
+						Valid[RayIndex] = (X < EndX) && (Y < EndY);
+						Rays[RayIndex] = {};
+						if(Valid[RayIndex])
+						{
+							float XOffset = RandomUnilateral(Entropy);
+							float YOffset = RandomUnilateral(Entropy);
+							Rays[RayIndex] = GenerateCameraRay(RenderState, X, Y, XOffset, YOffset);
+							++ValidCount;
+						}
+					}
+				}
+
+				{
+					TIMED_BLOCK_COUNTED(Traverse, ValidCount);
+					InitialisePacket(Packet, Rays, Valid, PacketRayCount);
+					PacketKdTreeIntersection(Packet, &RenderState->Trees[0], RenderState);
+				}
+
+				{
+					TIMED_BLOCK_COUNTED(Shade, ValidCount);
+					for(u32 RayIndex = 0; RayIndex < PacketRayCount; ++RayIndex)
+					{
+						if(Valid[RayIndex])
+						{
+							hit_record HitRecord = GetPacketHitRecord(Packet, RayIndex, Rays[RayIndex], RenderState->Vertices);
+							if(PrimaryOnly)
+							{
+								SampleSums[RayIndex] += PrimaryRayColor(RenderState, Rays[RayIndex], &HitRecord);
+								++RayCount;
+							}
+							else
+							{
+								ray_context Context = {};
+								Context.Throughput = V3(1.0f, 1.0f, 1.0f);
+								Context.RayShot = 1;
+								Context.Entropy = Entropy;
+								SampleSums[RayIndex] += ShadeRayHit(RenderState, Rays[RayIndex], &HitRecord, &Context);
+								RayCount += Context.RayShot;
+							}
+						}
+					}
+				}
+			}
+
+			for(u32 RayIndex = 0; RayIndex < PacketRayCount; ++RayIndex)
+			{
+				if(Valid[RayIndex])
+				{
+					u32 X = PacketX + RayIndex % PacketSize;
+					u32 Y = PacketY + RayIndex / PacketSize;
+					ShootRayChunkData->Target[X + Y * Pitch] = SampleSums[RayIndex];
+				}
+			}
+		}
+	}
+
+	EndTemporaryMemory(ScratchMemory);
+	return(RayCount);
+}
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+// NOTE(hugo): Hardware cache miss counter, read around a stage to get
+// its misses. Only Linux has it (perf_event_open), and only when the
+// kernel lets us (see /proc/sys/kernel/perf_event_paranoid) : callers
+// must handle the counter not being available.
+//
+// The counter is opened on the main thread with inherit set, before
+// the workers are created, so it counts the misses of every thread.
+// A read gives the total of all the threads.
+//
+// The peak resident memory of the process is here too.
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+struct cache_miss_counter
+{
+	s32 FileDescriptor;
+};
+
+internal bool
+OpenCacheMissCounter(cache_miss_counter* Counter)
+{
+	Counter->FileDescriptor = -1;
+#ifdef __linux__
+	struct perf_event_attr Attributes = {};
+	Attributes.type = PERF_TYPE_HARDWARE;
+	Attributes.size = sizeof(Attributes);
+	Attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+	Attributes.inherit = 1;
+	Attributes.exclude_kernel = 1;
+	Attributes.exclude_hv = 1;
+	Counter->FileDescriptor = s32(syscall(__NR_perf_event_open, &Attributes, 0, -1, -1, 0));
+#endif
+	return(Counter->FileDescriptor >= 0);
+}
+
+internal u64
+ReadCacheMissCounter(cache_miss_counter* Counter)
+{
+	u64 Result = 0;
+#ifdef __linux__
+	if(Counter->FileDescriptor >= 0)
+	{
+		if(read(Counter->FileDescriptor, &Result, sizeof(Result)) != sizeof(Result))
+		{
+			Result = 0;
+		}
+	}
+#endif
+	return(Result);
+}
+
+// NOTE(hugo): Largest resident set of the process so far, 0 if unknown.
+internal u64
+GetPeakResidentBytes(void)
+{
+	u64 Result = 0;
+#ifndef _WIN32
+	struct rusage Usage = {};
+	if(getrusage(RUSAGE_SELF, &Usage) == 0)
+	{
+#ifdef __APPLE__
+		Result = u64(Usage.ru_maxrss);
+#else
+		// NOTE(hugo): Linux gives kilobytes.
+		Result = 1024 * u64(Usage.ru_maxrss);
+#endif
+	}
+#endif
+	return(Result);
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+// NOTE(hugo): Timed blocks, to see where the cycles of a pass go.
+// A TIMED_BLOCK(Name) at the top of a scope reads the cycle counter
+// when the scope is entered and when it is left, and adds the
+// difference to the counter of that block for the calling thread.
+// Each thread has its own counters, on their own cache lines, so
+// there is no contention : the report sums all of them.
+//
+// Blocks nest. A block knows the block that was open when it
+// started, and gives its own time to it, so that each block has both
+// its total time and its self time (total minus the blocks inside).
+// When blocks of the same kind nest (shading calls traversal and
+// shading again, a kernel block holds one block per ray) only the
+// outermost one adds to the total and to the hits, so totals never
+// count the same cycles twice.
+//
+// RAY_PROFILE 0 compiles everything to nothing. 1 keeps the blocks
+// around tasks and stages (TIMED_BLOCK), a few thousand per pass. 2
+// adds the blocks around each ray (TIMED_RAY_BLOCK) : reading the
+// cycle counter six times per ray is not free (around 15% slower
+// on a VM where one read takes 20ns), so only use it to dig.
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum timed_block_id
+{
+	TimedBlock_Load,
+	TimedBlock_Build,
+	TimedBlock_Tile,
+	TimedBlock_Generate,
+	TimedBlock_Traverse,
+	TimedBlock_Shade,
+	TimedBlock_Resolve,
+	TimedBlock_Present,
+
+	TimedBlock_Count,
+};
+
+global_variable char* TimedBlockNames[TimedBlock_Count] =
+{
+	"load", "build", "tile", "generate", "traverse", "shade", "resolve", "present",
+};
+
+struct timed_block_counter
+{
+	u64 Cycles;
+	u64 SelfCycles;
+	u64 HitCount;
+};
+
+struct timed_block;
+struct alignas(64) thread_profile
+{
+	timed_block_counter Counters[TimedBlock_Count];
+	// NOTE(hugo): How many blocks of each kind are open, to spot recursion.
+	u32 OpenCount[TimedBlock_Count];
+	timed_block* Innermost;
+};
+
+// NOTE(hugo): Indexed by the deque index of the thread, 0 being the
+// main thread, which also times the loading before the workers exist.
+#define MAX_PROFILED_THREAD_COUNT 128
+global_variable thread_profile GlobalThreadProfiles[MAX_PROFILED_THREAD_COUNT];
+
+inline u64
+ReadCycleCounter(void)
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return(__rdtsc());
+#else
+	return(SDL_GetPerformanceCounter());
+#endif
+}
+
+struct timed_block
+{
+	thread_profile* Profile;
+	timed_block* Outer;
+	u64 StartCycles;
+	u64 InnerCycles;
+	u64 HitCount;
+	timed_block_id ID;
+
+	timed_block(timed_block_id BlockID, u64 BlockHitCount = 1)
+	{
+		Assert(GlobalThreadDequeIndex < MAX_PROFILED_THREAD_COUNT);
+		Profile = GlobalThreadProfiles + GlobalThreadDequeIndex;
+		Outer = Profile->Innermost;
+		Profile->Innermost = this;
+		++Profile->OpenCount[BlockID];
+		InnerCycles = 0;
+		HitCount = BlockHitCount;
+		ID = BlockID;
+		StartCycles = ReadCycleCounter();
+	}
+
+	~timed_block(void)
+	{
+		u64 Elapsed = ReadCycleCounter() - StartCycles;
+		timed_block_counter* Counter = Profile->Counters + ID;
+		if(--Profile->OpenCount[ID] == 0)
+		{
+			Counter->Cycles += Elapsed;
+			Counter->HitCount += HitCount;
+		}
+		Counter->SelfCycles += Elapsed - InnerCycles;
+		Profile->Innermost = Outer;
+		if(Outer)
+		{
+			Outer->InnerCycles += Elapsed;
+		}
+	}
+};
+
+#if RAY_PROFILE
+#define TIMED_BLOCK__(ID, Number, HitCount) timed_block TimedBlock_##Number(TimedBlock_##ID, HitCount)
+#define TIMED_BLOCK_(ID, Number, HitCount) TIMED_BLOCK__(ID, Number, HitCount)
+#define TIMED_BLOCK(ID) TIMED_BLOCK_(ID, __LINE__, 1)
+// NOTE(hugo): One block standing for HitCount items (rays of a packet, paths of a kernel).
+#define TIMED_BLOCK_COUNTED(ID, HitCount) TIMED_BLOCK_(ID, __LINE__, HitCount)
+#else
+#define TIMED_BLOCK(ID)
+#define TIMED_BLOCK_COUNTED(ID, HitCount)
+#endif
+
+#if RAY_PROFILE >= 2
+#define TIMED_RAY_BLOCK(ID) TIMED_BLOCK_(ID, __LINE__, 1)
+#else
+#define TIMED_RAY_BLOCK(ID)
+#endif
+
+// NOTE(hugo): The sum of every thread counters at some point in time.
+// A report prints the difference between two of these, so nothing
+// is ever reset while the workers are still adding to the counters.
+struct profile_snapshot
+{
+	timed_block_counter Counters[TimedBlock_Count];
+	u64 CycleCounter;
+	u64 PerformanceCounter;
+};
+
+internal profile_snapshot
+TakeProfileSnapshot(void)
+{
+	profile_snapshot Result = {};
+	for(u32 ThreadIndex = 0; ThreadIndex < MAX_PROFILED_THREAD_COUNT; ++ThreadIndex)
+	{
+		thread_profile* Profile = GlobalThreadProfiles + ThreadIndex;
+		for(u32 BlockIndex = 0; BlockIndex < TimedBlock_Count; ++BlockIndex)
+		{
+			timed_block_counter volatile* Counter = Profile->Counters + BlockIndex;
+			Result.Counters[BlockIndex].Cycles += Counter->Cycles;
+			Result.Counters[BlockIndex].SelfCycles += Counter->SelfCycles;
+			Result.Counters[BlockIndex].HitCount += Counter->HitCount;
+		}
+	}
+	Result.CycleCounter = ReadCycleCounter();
+	Result.PerformanceCounter = SDL_GetPerformanceCounter();
+	return(Result);
+}
+
+internal void
+PrintProfile(profile_snapshot* Begin, profile_snapshot* End, char* Label)
+{
+	double Seconds = double(End->PerformanceCounter - Begin->PerformanceCounter) / double(SDL_GetPerformanceFrequency());
+	double CyclesPerMS = (Seconds > 0.0) ? double(End->CycleCounter - Begin->CycleCounter) / (1000.0 * Seconds) : 1.0;
+
+	u64 TotalSelfCycles = 0;
+	for(u32 BlockIndex = 0; BlockIndex < TimedBlock_Count; ++BlockIndex)
+	{
+		TotalSelfCycles += End->Counters[BlockIndex].SelfCycles - Begin->Counters[BlockIndex].SelfCycles;
+	}
+
+	// NOTE(hugo): The cycles of all the threads are added together.
+	printf("Profile of %s : %.1fms, cycle counter at %.2f GHz.\n",
+			Label, 1000.0 * Seconds, CyclesPerMS / 1000000.0);
+	printf("\t%-10s %12s %12s %12s %12s %8s\n", "block", "hits", "Mcycles", "self Mcycles", "self/hit", "self %");
+	for(u32 BlockIndex = 0; BlockIndex < TimedBlock_Count; ++BlockIndex)
+	{
+		u64 HitCount = End->Counters[BlockIndex].HitCount - Begin->Counters[BlockIndex].HitCount;
+		if(HitCount > 0)
+		{
+			u64 Cycles = End->Counters[BlockIndex].Cycles - Begin->Counters[BlockIndex].Cycles;
+			u64 SelfCycles = End->Counters[BlockIndex].SelfCycles - Begin->Counters[BlockIndex].SelfCycles;
+			printf("\t%-10s %12llu %12.2f %12.2f %12.1f %7.1f%%\n", TimedBlockNames[BlockIndex],
+					(unsigned long long)HitCount, double(Cycles) / 1000000.0, double(SelfCycles) / 1000000.0,
+					double(SelfCycles) / double(HitCount),
+					(TotalSelfCycles > 0) ? 100.0 * double(SelfCycles) / double(TotalSelfCycles) : 0.0);
+		}
+	}
+}
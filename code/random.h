@@ -38,6 +38,17 @@ inline u64 RandomNextU64(random_series *Series)
     return(Result);
 }
 
+// NOTE(hugo): splitmix64, used to turn an index into
+// well mixed seeds for independent series.
+inline u64 SplitMix64(u64* State)
+{
+	*State += 0x9E3779B97F4A7C15;
+	u64 Result = *State;
+	Result = (Result ^ (Result >> 30)) * 0xBF58476D1CE4E5B9;
+	Result = (Result ^ (Result >> 27)) * 0x94D049BB133111EB;
+	return(Result ^ (Result >> 31));
+}
+
 inline u32 RandomNextU32(random_series* Series)
 {
 	u64 NextU64 = RandomNextU64(Series);
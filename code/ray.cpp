@@ -8,11 +8,26 @@
 
 #include "rivten.h"
 #include "rivten_math.h"
+#include "rivten_simd.h"
 #include "random.h"
 #include "kdtree.h"
 
 #define RAY_COMPUTE_VARIATION 1
 
+// NOTE(hugo): Traversal counters and heatmaps (traversal_stats.cpp).
+#ifndef RAY_TRAVERSAL_STATS
+#define RAY_TRAVERSAL_STATS 0
+#endif
+
+// NOTE(hugo): Timed blocks (profiler.cpp), 2 to also time each ray.
+#ifndef RAY_PROFILE
+#define RAY_PROFILE 1
+#endif
+
+#define RAY_SSE RIVTEN_SIMD_SSE
+// NOTE(hugo): Packet groups are 8 rays wide when built with -mavx.
+#define RAY_AVX RIVTEN_SIMD_AVX
+
 #define SDL_CHECK(Op) {s32 Result = (Op); Assert(Result == 0);}
 #define MAX_FLOAT32 FLT_MAX
 
@@ -31,25 +46,8 @@
 	> Weird crash when setting the maximum amount of triangle in a leaf
 */
 
-#if 0
-global_variable u32 GlobalWindowWidth = 1024;
-global_variable u32 GlobalWindowHeight = 1024;
-#else
-global_variable u32 GlobalWindowWidth = 512;
-global_variable u32 GlobalWindowHeight = 512;
-#endif
 global_variable bool GlobalRunning = true;
 global_variable bool GlobalComputed = false;
-global_variable u32 GlobalAACount = 20000;
-
-global_variable u32 GlobalChunkWidth = 64;
-global_variable u32 GlobalChunkHeight = 64;
-
-#if 1
-// NOTE(hugo): DEBUG DATA
-global_variable u32 DEBUGRayCount = 0;
-global_variable u64 DEBUGCycleCountPass = 0;
-#endif
 
 internal u32
 RGBToPixel(u8 R, u8 G, u8 B)
@@ -88,6 +86,8 @@ LinearToSRGB(v3 Linear)
 	return(GammaCorrectedColor);
 }
 
+#include "image.cpp"
+
 struct camera
 {
 	v3 P;
@@ -111,35 +111,84 @@ struct persistent_render_value
 	v3 CameraYAxis;
 };
 
+#include "cpu_topology.cpp"
+#include "perf_counters.cpp"
+#include "trace.cpp"
+#include "memory_report.cpp"
 #include "multithreading.h"
-
+#include "profiler.cpp"
+#include "tile_order.cpp"
+#include "resolve.cpp"
+#include "config.cpp"
+#include "traversal_stats.cpp"
+
+struct wavefront_state;
+
+// NOTE(hugo): A tile of the screen. Tiles are created once and
+// reused for every pass : a task renders SampleCount samples per
+// pixel of its tile and adds them straight into the framebuffer.
+// Tiles never overlap so no synchronisation is needed there. Each
+// tile has cache lines of its own since its task writes its counters.
 struct render_state;
-struct shoot_ray_block_data
+struct alignas(64) shoot_ray_block_data
 {
-	v3* BackbufferChunk;
 	render_state* RenderState;
 	u32 ChunkStartX;
 	u32 ChunkStartY;
+	// NOTE(hugo): Smaller than the configured tile size
+	// on the right and bottom edges of the screen.
+	u32 ChunkWidth;
+	u32 ChunkHeight;
+	u32 SampleCount;
 	u32 RayCount;
+	u64 Cycles;
+	// NOTE(hugo): Pass buffer the tile writes its samples to.
+	v3* Target;
 	u64 SeedAlpha;
 	u64 SeedBeta;
+#if RAY_TRAVERSAL_STATS
+	traversal_stats TraversalStats;
+#endif
 };
 
 struct render_state
 {
+	render_config Config;
+
 	memory_arena Arena;
-	temporary_memory TempMemory;
+	// NOTE(hugo): The triangles, vertices and tree nodes, on their own
+	// so that they can ask for huge pages without the framebuffers.
+	memory_arena SceneArena;
+
+	// NOTE(hugo): Sum of every sample rendered so far, per pixel.
+	v3* Backbuffer;
+
+	// NOTE(hugo): Passes are double-buffered : while the workers
+	// render a pass into one buffer, the main thread adds the
+	// previous pass, stored in the other one, to the Backbuffer
+	// and presents it. Each buffer has its own task group.
+	v3* PassBuffers[2];
+	platform_task_group PassGroups[2];
+
+	// NOTE(hugo): The spheres, materials and tiles are each in an arena
+	// of their own, only holding them : they can grow as long as there
+	// is memory, without ever moving.
+	memory_arena SphereArena;
 	u32 SphereCount;
-	sphere Spheres[256];
+	sphere* Spheres;
 
 	kdtree* Trees;
 	u32 TreeCount;
+	double TreeBuildMS;
 
+	u32 TriangleCount;
+	triangle* Triangles;
 	u32 VertexCount;
 	vertex* Vertices;
 
+	memory_arena MaterialArena;
 	u32 MaterialCount;
-	material Materials[256];
+	material* Materials;
 
 	camera Camera;
 	float FocalLength;
@@ -148,8 +197,19 @@ struct render_state
 
 	platform_work_queue Queue;
 
+	u32 ChunkWidth;
+	u32 ChunkHeight;
+	memory_arena TileArena;
 	u32 ShootRayChunkCount;
-	shoot_ray_block_data ShootRayChunkPool[256];
+	shoot_ray_block_data* ShootRayChunkPool;
+
+	// NOTE(hugo): Only used by the wavefront integrator.
+	wavefront_state* Wavefront;
+
+#if RAY_TRAVERSAL_STATS
+	// NOTE(hugo): Summed over every pass.
+	traversal_stats* PixelTraversalStats;
+#endif
 
 	random_series Entropy;
 
@@ -179,16 +239,18 @@ Reflect(v3 V, v3 N)
 internal void
 PushSphere(render_state* RenderState, sphere S)
 {
-	Assert(RenderState->SphereCount < ArrayCount(RenderState->Spheres));
-	RenderState->Spheres[RenderState->SphereCount] = S;
+	sphere* Sphere = PushStruct(&RenderState->SphereArena, sphere, NoClear());
+	Assert(Sphere == RenderState->Spheres + RenderState->SphereCount);
+	*Sphere = S;
 	++RenderState->SphereCount;
 }
 
 internal void
 PushMaterial(render_state* RenderState, material M)
 {
-	Assert(RenderState->MaterialCount < ArrayCount(RenderState->Materials));
-	RenderState->Materials[RenderState->MaterialCount] = M;
+	material* Material = PushStruct(&RenderState->MaterialArena, material, NoClear());
+	Assert(Material == RenderState->Materials + RenderState->MaterialCount);
+	*Material = M;
 	++RenderState->MaterialCount;
 }
 
@@ -220,6 +282,8 @@ GetRandomPointInUnitSphere(random_series* Entropy)
 
 #include "intersection.cpp"
 #include "kdtree.cpp"
+#include "lbvh.cpp"
+#include "refit.cpp"
 
 struct ray_context
 {
@@ -229,37 +293,40 @@ struct ray_context
 	random_series* Entropy;
 };
 
-// TODO(hugo): Maybe unroll this recursive call ?
-internal v3
-ShootRay(render_state* RenderState, ray Ray, ray_context* Context)
+inline v3
+BackgroundColor(v3 Dir)
 {
-	++Context->RayShot;
-	hit_record ClosestHitRecord = {};
-	ClosestHitRecord.t = MAX_FLOAT32;
-
-#if 0
-	for(u32 SphereIndex = 0; SphereIndex < RenderState->SphereCount; ++SphereIndex)
-	{
-		sphere* S = RenderState->Spheres + SphereIndex;
-		RaySphereIntersection(S, Ray, &ClosestHitRecord);
-	}
+#if 1
+	float t = 0.5f * (1.0f + Dir.y);
+	return(Lerp(V3(1.0f, 1.0f, 1.0f), t, V3(0.5f, 0.7f, 1.0f)));
+#else
+	return(V3(0.0f, 0.0f, 0.0f));
 #endif
-	RayKdTreeIntersection(Ray, &RenderState->Trees[0], RenderState, &ClosestHitRecord);
+}
+
+internal v3 ShootRay(render_state* RenderState, ray Ray, ray_context* Context);
 
-	if(ClosestHitRecord.t < MAX_FLOAT32)
+// NOTE(hugo): Everything ShootRay does once the closest hit of the
+// ray is known, so that rays traced some other way (packets) can
+// continue their path from there.
+internal v3
+ShadeRayHit(render_state* RenderState, ray Ray, hit_record* ClosestHitRecord, ray_context* Context)
+{
+	TIMED_RAY_BLOCK(Shade);
+	if(ClosestHitRecord->t < MAX_FLOAT32)
 	{
 		ray NextRay = {};
-		NextRay.Start = ClosestHitRecord.P;
-		v3 TargetDiffuse = ClosestHitRecord.N + GetRandomPointInUnitSphere(&RenderState->Entropy);
-		v3 TargetSpecular = Reflect(Ray.Dir, ClosestHitRecord.N);
-		material* M = RenderState->Materials + ClosestHitRecord.MaterialIndex;
+		NextRay.Start = ClosestHitRecord->P;
+		v3 TargetDiffuse = ClosestHitRecord->N + GetRandomPointInUnitSphere(Context->Entropy);
+		v3 TargetSpecular = Reflect(Ray.Dir, ClosestHitRecord->N);
+		material* M = RenderState->Materials + ClosestHitRecord->MaterialIndex;
 
 		if(M->IsLight)
 		{
 			return(M->Emissivity);
 		}
 
-		NextRay.Dir = Normalized(Lerp(TargetSpecular, M->Scatter, TargetDiffuse));
+		NextRay.Dir = NormalizedFast(Lerp(TargetSpecular, M->Scatter, TargetDiffuse));
 
 		v3 RayColor = M->Attenuation * M->Albedo;
 
@@ -283,76 +350,187 @@ ShootRay(render_state* RenderState, ray Ray, ray_context* Context)
 	}
 	else
 	{
-#if 1
 		// NOTE(hugo): No hit : Background color
-		float t = 0.5f * (1.0f + Ray.Dir.y);
-		return(Lerp(V3(1.0f, 1.0f, 1.0f), t, V3(0.5f, 0.7f, 1.0f)));
-#else
-		return(V3(0.0f, 0.0f, 0.0f));
+		return(BackgroundColor(Ray.Dir));
+	}
+}
+
+// TODO(hugo): Maybe unroll this recursive call ?
+internal v3
+ShootRay(render_state* RenderState, ray Ray, ray_context* Context)
+{
+	++Context->RayShot;
+	hit_record ClosestHitRecord = {};
+	ClosestHitRecord.t = MAX_FLOAT32;
+
+#if 0
+	for(u32 SphereIndex = 0; SphereIndex < RenderState->SphereCount; ++SphereIndex)
+	{
+		sphere* S = RenderState->Spheres + SphereIndex;
+		RaySphereIntersection(S, Ray, &ClosestHitRecord);
+	}
 #endif
+	{
+		TIMED_RAY_BLOCK(Traverse);
+		RayKdTreeIntersection(Ray, &RenderState->Trees[0], RenderState, &ClosestHitRecord);
+	}
 
+	return(ShadeRayHit(RenderState, Ray, &ClosestHitRecord, Context));
+}
+
+// NOTE(hugo): Color of the first surface seen, without any bounce.
+// Used to measure the primary ray throughput alone.
+internal v3
+PrimaryRayColor(render_state* RenderState, ray Ray, hit_record* ClosestHitRecord)
+{
+	TIMED_RAY_BLOCK(Shade);
+	if(ClosestHitRecord->t < MAX_FLOAT32)
+	{
+		material* M = RenderState->Materials + ClosestHitRecord->MaterialIndex;
+		v3 SurfaceColor = M->IsLight ? M->Emissivity : M->Albedo;
+		return(Abs(Dot(ClosestHitRecord->N, Ray.Dir)) * SurfaceColor);
+	}
+	else
+	{
+		return(BackgroundColor(Ray.Dir));
 	}
 }
 
-PLATFORM_WORK_QUEUE_CALLBACK(ShootRayChunk)
+internal v3
+ShootPrimaryRay(render_state* RenderState, ray Ray, ray_context* Context)
 {
-	shoot_ray_block_data* ShootRayChunkData = (shoot_ray_block_data *)Data;
+	++Context->RayShot;
+	hit_record ClosestHitRecord = {};
+	ClosestHitRecord.t = MAX_FLOAT32;
+	{
+		TIMED_RAY_BLOCK(Traverse);
+		RayKdTreeIntersection(Ray, &RenderState->Trees[0], RenderState, &ClosestHitRecord);
+	}
+	return(PrimaryRayColor(RenderState, Ray, &ClosestHitRecord));
+}
 
-	render_state* RenderState = ShootRayChunkData->RenderState;
+// NOTE(hugo): Camera ray through the point (X + XOffset, Y + YOffset)
+// of the screen, offsets being in [0, 1].
+internal ray
+GenerateCameraRay(render_state* RenderState, u32 X, u32 Y, float XOffset, float YOffset)
+{
+	TIMED_RAY_BLOCK(Generate);
 	float ScreenWidth = RenderState->PersistentRenderValue.ScreenWidth;
 	float ScreenHeight = RenderState->PersistentRenderValue.ScreenHeight;
 	v3 CameraYAxis = RenderState->PersistentRenderValue.CameraYAxis;
+	float WindowWidth = float(RenderState->Config.Width);
+	float WindowHeight = float(RenderState->Config.Height);
+
+	ray Ray = {};
+	Ray.Start = RenderState->Camera.P;
+	v2 PixelRelativeCoordInScreen = V2(((float(X) + XOffset) / WindowWidth) - 0.5f, 0.5f - ((float(Y) + YOffset) / WindowHeight));
+	v3 PixelWorldSpace = RenderState->Camera.P - RenderState->FocalLength * RenderState->Camera.ZAxis +
+		PixelRelativeCoordInScreen.x * ScreenWidth * RenderState->Camera.XAxis + PixelRelativeCoordInScreen.y * ScreenHeight * CameraYAxis;
+	// TODO(hugo): Do we need to have a normalized direction ? Maybe not...
+	Ray.Dir = NormalizedFast(PixelWorldSpace - Ray.Start);
+	return(Ray);
+}
+
+#include "packet.cpp"
+
+PLATFORM_WORK_QUEUE_CALLBACK(ShootRayChunk)
+{
+	shoot_ray_block_data* ShootRayChunkData = (shoot_ray_block_data *)Data;
+
+	render_state* RenderState = ShootRayChunkData->RenderState;
+	TIMED_BLOCK(Tile);
+
+	u64 StartCycles = SDL_GetPerformanceCounter();
+	u32 ChunkWidth = ShootRayChunkData->ChunkWidth;
+	u32 ChunkHeight = ShootRayChunkData->ChunkHeight;
+	u32 Pitch = RenderState->Config.Width;
+	u32 SampleCount = ShootRayChunkData->SampleCount;
+	u32 RayCount = 0;
 
 	random_series ThreadRandomSeries = RandomSeed(ShootRayChunkData->SeedAlpha, ShootRayChunkData->SeedBeta);
+#if RAY_TRAVERSAL_STATS
+	traversal_stats TileStartStats = GlobalThreadTraversalStats;
+#endif
 
 	u32 StartX = ShootRayChunkData->ChunkStartX;
-	u32 EndX = StartX + GlobalChunkWidth;
+	u32 EndX = StartX + ChunkWidth;
 	u32 StartY = ShootRayChunkData->ChunkStartY;
-	u32 EndY = StartY + GlobalChunkHeight;
-	for(u32 Y = StartY; Y < EndY; ++Y)
+	u32 EndY = StartY + ChunkHeight;
+#if RAY_SSE
+	if(RenderState->Config.PacketSize > 0)
 	{
-		for(u32 X = StartX; X < EndX; ++X)
+		RayCount = RenderTilePackets(ShootRayChunkData, &ThreadRandomSeries);
+	}
+	else
+#endif
+	{
+		for(u32 Y = StartY; Y < EndY; ++Y)
 		{
-			v3* Color = ShootRayChunkData->BackbufferChunk + (X - StartX) + (Y - StartY) * GlobalChunkWidth;
-
-			ray Ray = {};
-			Ray.Start = RenderState->Camera.P;
-			float XOffset = RandomUnilateral(&RenderState->Entropy);
-			float YOffset = RandomUnilateral(&RenderState->Entropy);
-			Assert(XOffset >= 0.0f && XOffset <= 1.0f);
-			Assert(YOffset >= 0.0f && YOffset <= 1.0f);
-			v2 PixelRelativeCoordInScreen = V2(((float(X) + XOffset) / float(GlobalWindowWidth)) - 0.5f, 0.5f - ((float(Y) + YOffset) / float(GlobalWindowHeight)));
-			v3 PixelWorldSpace = RenderState->Camera.P - RenderState->FocalLength * RenderState->Camera.ZAxis +
-				PixelRelativeCoordInScreen.x * ScreenWidth * RenderState->Camera.XAxis + PixelRelativeCoordInScreen.y * ScreenHeight * CameraYAxis;
-			// TODO(hugo): Do we need to have a normalized direction ? Maybe not...
-			Ray.Dir = Normalized(PixelWorldSpace - Ray.Start);
-
-			ray_context Context = {};
-			Context.Throughput = V3(1.0f, 1.0f, 1.0f);
-			Context.RayShot = 0;
-			Context.Entropy = &ThreadRandomSeries;
-			*Color += ShootRay(RenderState, Ray, &Context);
-
-			ShootRayChunkData->RayCount += Context.RayShot;
+			for(u32 X = StartX; X < EndX; ++X)
+			{
+				v3* Color = ShootRayChunkData->Target + X + Y * Pitch;
+				v3 SampleSum = {};
+#if RAY_TRAVERSAL_STATS
+				traversal_stats PixelStartStats = GlobalThreadTraversalStats;
+#endif
+
+				for(u32 SampleIndex = 0; SampleIndex < SampleCount; ++SampleIndex)
+				{
+					float XOffset = RandomUnilateral(&ThreadRandomSeries);
+					float YOffset = RandomUnilateral(&ThreadRandomSeries);
+					Assert(XOffset >= 0.0f && XOffset <= 1.0f);
+					Assert(YOffset >= 0.0f && YOffset <= 1.0f);
+					ray Ray = GenerateCameraRay(RenderState, X, Y, XOffset, YOffset);
+
+					ray_context Context = {};
+					Context.Throughput = V3(1.0f, 1.0f, 1.0f);
+					Context.RayShot = 0;
+					Context.Entropy = &ThreadRandomSeries;
+					if(RenderState->Config.PrimaryOnly)
+					{
+						SampleSum += ShootPrimaryRay(RenderState, Ray, &Context);
+					}
+					else
+					{
+						SampleSum += ShootRay(RenderState, Ray, &Context);
+					}
+
+					RayCount += Context.RayShot;
+				}
+
+				*Color = SampleSum;
+#if RAY_TRAVERSAL_STATS
+				AddTraversalStats(RenderState->PixelTraversalStats + X + Y * Pitch,
+						SubtractTraversalStats(GlobalThreadTraversalStats, PixelStartStats));
+#endif
+			}
 		}
 	}
+
+#if RAY_TRAVERSAL_STATS
+	ShootRayChunkData->TraversalStats = SubtractTraversalStats(GlobalThreadTraversalStats, TileStartStats);
+#endif
+
+	ShootRayChunkData->RayCount = RayCount;
+	ShootRayChunkData->Cycles = SDL_GetPerformanceCounter() - StartCycles;
+	TraceTask("tile", u32(ShootRayChunkData - RenderState->ShootRayChunkPool), RayCount);
 }
 
+#include "wavefront.cpp"
+
 internal shoot_ray_block_data*
 GetShootRayChunkData(render_state* RenderState)
 {
-	Assert(RenderState->ShootRayChunkCount < ArrayCount(RenderState->ShootRayChunkPool));
-	shoot_ray_block_data* Result = RenderState->ShootRayChunkPool + RenderState->ShootRayChunkCount;
-	*Result = {};
+	shoot_ray_block_data* Result = PushStruct(&RenderState->TileArena, shoot_ray_block_data, Align(64, true));
+	Assert(Result == RenderState->ShootRayChunkPool + RenderState->ShootRayChunkCount);
 	++RenderState->ShootRayChunkCount;
 	return(Result);
 }
 
-#define KD_TREE_NO_CHILD 0xFFFFFFFF
 internal kdtree*
 CreateKDTreeRoot(render_state* RenderState)
 {
-	RenderState->Trees = PushStruct(&RenderState->Arena, kdtree);
+	RenderState->Trees = PushStruct(&RenderState->SceneArena, kdtree);
 	RenderState->Trees[0].LeftIndex = KD_TREE_NO_CHILD;
 	RenderState->Trees[0].RightIndex = KD_TREE_NO_CHILD;
 
@@ -366,7 +544,7 @@ CreateKDTree(render_state* RenderState)
 {
 	u32 Result = RenderState->TreeCount;
 
-	kdtree* Tree = PushStruct(&RenderState->Arena, kdtree);
+	kdtree* Tree = PushStruct(&RenderState->SceneArena, kdtree);
 	Tree->LeftIndex = KD_TREE_NO_CHILD;
 	Tree->RightIndex = KD_TREE_NO_CHILD;
 
@@ -385,87 +563,476 @@ GetKDTreeFromPool(u32 Index, render_state* RenderState)
 	return(0);
 }
 
+// NOTE(hugo): Cuts the screen in tiles of the configured size, the
+// last column and row being smaller when the resolution is not a
+// multiple of it. The tile pool is sorted in dispatch order.
 internal void
-RenderBackbuffer(render_state* RenderState)
+CreateTiles(render_state* RenderState, u32 ChunkWidth, u32 ChunkHeight)
+{
+	render_config* Config = &RenderState->Config;
+	u32 XChunkCount = (Config->Width + ChunkWidth - 1) / ChunkWidth;
+	u32 YChunkCount = (Config->Height + ChunkHeight - 1) / ChunkHeight;
+
+	RenderState->ChunkWidth = ChunkWidth;
+	RenderState->ChunkHeight = ChunkHeight;
+	RenderState->ShootRayChunkCount = 0;
+	ClearArena(&RenderState->TileArena);
+
+	u32 TileCount = XChunkCount * YChunkCount;
+	temporary_memory TempMemory = BeginTemporaryMemory(&RenderState->Arena);
+	tile_sort_entry* SortEntries = PushArray(&RenderState->Arena, TileCount, tile_sort_entry);
+	ComputeTileOrder(SortEntries, XChunkCount, YChunkCount, Config->TileOrder);
+
+	for(u32 TileIndex = 0; TileIndex < TileCount; ++TileIndex)
+	{
+		u32 XChunk = SortEntries[TileIndex].XChunk;
+		u32 YChunk = SortEntries[TileIndex].YChunk;
+
+		shoot_ray_block_data* ShootRayChunkData = GetShootRayChunkData(RenderState);
+		ShootRayChunkData->ChunkStartX = ChunkWidth * XChunk;
+		ShootRayChunkData->ChunkStartY = ChunkHeight * YChunk;
+		ShootRayChunkData->ChunkWidth = Minu(ChunkWidth, Config->Width - ShootRayChunkData->ChunkStartX);
+		ShootRayChunkData->ChunkHeight = Minu(ChunkHeight, Config->Height - ShootRayChunkData->ChunkStartY);
+		ShootRayChunkData->SampleCount = Config->SamplesPerTask;
+		ShootRayChunkData->RenderState = RenderState;
+	}
+	EndTemporaryMemory(TempMemory);
+}
+
+#define TILE_MIN_SIZE 8
+#define TILE_MAX_SIZE 256
+
+// NOTE(hugo): Adapts the tile size to what the last pass measured.
+// A tile that costs a large part of the pass leaves the other
+// threads idle at the end of it : tiles are split. Tiles that are
+// so cheap that scheduling overhead shows are merged.
+// Returns true if the tiles were rebuilt.
+internal bool
+AutoTuneTileSize(render_state* RenderState, u64 PassCycles)
 {
-	Assert(GlobalWindowHeight % GlobalChunkHeight == 0);
-	Assert(GlobalWindowWidth % GlobalChunkWidth == 0);
-	u32 YChunkCount = GlobalWindowHeight / GlobalChunkHeight;
-	u32 XChunkCount = GlobalWindowWidth / GlobalChunkWidth;
-	for(u32 YChunk = 0; YChunk < YChunkCount; ++YChunk)
+	u32 TileCount = RenderState->ShootRayChunkCount;
+	u32 ThreadCount = RenderState->Queue.DequeCount;
+	u64 MaxTileCycles = 0;
+	u64 TotalTileCycles = 0;
+	for(u32 TileIndex = 0; TileIndex < TileCount; ++TileIndex)
+	{
+		u64 Cycles = RenderState->ShootRayChunkPool[TileIndex].Cycles;
+		TotalTileCycles += Cycles;
+		if(Cycles > MaxTileCycles)
+		{
+			MaxTileCycles = Cycles;
+		}
+	}
+	double MeanTileMS = 1000.0 * double(TotalTileCycles) /
+		(double(TileCount) * double(SDL_GetPerformanceFrequency()));
+
+	u32 ChunkWidth = RenderState->ChunkWidth;
+	u32 ChunkHeight = RenderState->ChunkHeight;
+	bool TooCoarse = (8 * MaxTileCycles > PassCycles) || (TileCount < 4 * ThreadCount);
+	bool TooFine = (MeanTileMS < 0.25) && (TileCount > 16 * ThreadCount);
+	if(TooCoarse)
 	{
-		for(u32 XChunk = 0; XChunk < XChunkCount; ++XChunk)
+		if(ChunkWidth >= ChunkHeight && ChunkWidth > TILE_MIN_SIZE)
+		{
+			ChunkWidth /= 2;
+		}
+		else if(ChunkHeight > TILE_MIN_SIZE)
 		{
-			shoot_ray_block_data* ShootRayChunkData = GetShootRayChunkData(RenderState);
-			ShootRayChunkData->ChunkStartX = GlobalChunkWidth * XChunk;
-			ShootRayChunkData->ChunkStartY = GlobalChunkHeight * YChunk;
-			ShootRayChunkData->BackbufferChunk = PushArray(&RenderState->Arena, GlobalChunkWidth * GlobalChunkHeight, v3, Align(64, true));
-			ShootRayChunkData->RenderState = RenderState;
-			ShootRayChunkData->SeedAlpha = RandomNextU64(&RenderState->Entropy);
-			ShootRayChunkData->SeedBeta = RandomNextU64(&RenderState->Entropy);
-			SDLAddEntry(&RenderState->Queue, ShootRayChunk, ShootRayChunkData);
+			ChunkHeight /= 2;
 		}
 	}
+	else if(TooFine)
+	{
+		if(ChunkWidth <= ChunkHeight && ChunkWidth < TILE_MAX_SIZE)
+		{
+			ChunkWidth *= 2;
+		}
+		else if(ChunkHeight < TILE_MAX_SIZE)
+		{
+			ChunkHeight *= 2;
+		}
+	}
+
+	bool Changed = ((ChunkWidth != RenderState->ChunkWidth) || (ChunkHeight != RenderState->ChunkHeight));
+	if(Changed)
+	{
+		CreateTiles(RenderState, ChunkWidth, ChunkHeight);
+		printf("\tTiles are now %ux%u (%u tiles)\n", ChunkWidth, ChunkHeight, RenderState->ShootRayChunkCount);
+	}
+	return(Changed);
 }
 
-int main(int ArgumentCount, char** Arguments)
+// NOTE(hugo): Queues one task per tile. Each tile gets fresh seeds
+// drawn on the main thread so that a render only depends on the
+// config seed, not on which thread ran which tile.
+internal void
+RenderBackbuffer(render_state* RenderState, u32 PassParity)
 {
-	u32 SDLInitParams = SDL_INIT_EVERYTHING;
-	SDL_CHECK(SDL_Init(SDLInitParams));
+	v3* Target = RenderState->PassBuffers[PassParity];
+	platform_task_group* Group = RenderState->PassGroups + PassParity;
 
-	printf("Cache line size = %dB\n", SDL_GetCPUCacheLineSize());
+	if(RenderState->Wavefront)
+	{
+		wavefront_state* Wavefront = RenderState->Wavefront;
+		Wavefront->PassSeed = RandomNextU64(&RenderState->Entropy);
+		Wavefront->Target = Target;
+		SDLAddEntry(&RenderState->Queue, Group, WavefrontPass, Wavefront);
+		return;
+	}
 
-	u32 WindowFlags = SDL_WINDOW_SHOWN;
-	SDL_Window* Window = SDL_CreateWindow("PathTracer", 
-			SDL_WINDOWPOS_UNDEFINED,
-			SDL_WINDOWPOS_UNDEFINED,
-			GlobalWindowWidth, GlobalWindowHeight,
-			WindowFlags);
+	// NOTE(hugo): The owner of a deque runs its most recently pushed
+	// task first, so the tiles are pushed from the last one to the
+	// first one : the first tiles of the order are rendered first.
+	for(u32 TileIndex = RenderState->ShootRayChunkCount; TileIndex-- > 0;)
+	{
+		shoot_ray_block_data* ShootRayChunkData = RenderState->ShootRayChunkPool + TileIndex;
+		ShootRayChunkData->SeedAlpha = RandomNextU64(&RenderState->Entropy);
+		ShootRayChunkData->SeedBeta = RandomNextU64(&RenderState->Entropy);
+		ShootRayChunkData->RayCount = 0;
+		ShootRayChunkData->Target = Target;
+		SDLAddEntry(&RenderState->Queue, Group, ShootRayChunk, ShootRayChunkData);
+	}
+}
 
-	Assert(Window);
+struct queue_benchmark_task
+{
+	u32 Iterations;
+	u32 Result;
+};
 
-	SDL_Surface* Screen = SDL_GetWindowSurface(Window);
-	Assert(Screen);
+PLATFORM_WORK_QUEUE_CALLBACK(QueueBenchmarkTask)
+{
+	queue_benchmark_task* Task = (queue_benchmark_task *)Data;
+	u32 Value = Task->Iterations;
+	for(u32 Iteration = 0; Iteration < Task->Iterations; ++Iteration)
+	{
+		Value ^= Value << 13;
+		Value ^= Value >> 17;
+		Value ^= Value << 5;
+	}
+	Task->Result = Value;
+}
+
+// NOTE(hugo): Scheduler contention benchmark : many tiny tasks,
+// the equivalent of a pass made of very small tiles, so that
+// the time is dominated by submitting and dequeuing.
+internal void
+RunQueueBenchmark(platform_work_queue* Queue, u32 TaskCount, memory_arena* Arena)
+{
+	u32 RoundCount = 64;
+	u32 IterationsPerTask = 256;
+	temporary_memory TempMemory = BeginTemporaryMemory(Arena);
+	queue_benchmark_task* Tasks = PushArray(Arena, TaskCount, queue_benchmark_task, Align(64, true));
+	double PerformanceFrequency = double(SDL_GetPerformanceFrequency());
 
+	// NOTE(hugo): Reference : the same work on the main thread only.
+	u64 SerialStart = SDL_GetPerformanceCounter();
+	for(u32 TaskIndex = 0; TaskIndex < TaskCount; ++TaskIndex)
+	{
+		Tasks[TaskIndex].Iterations = IterationsPerTask;
+		QueueBenchmarkTask(Queue, Tasks + TaskIndex);
+	}
+	double SerialSeconds = double(SDL_GetPerformanceCounter() - SerialStart) / PerformanceFrequency;
+
+	u64 Start = SDL_GetPerformanceCounter();
+	for(u32 RoundIndex = 0; RoundIndex < RoundCount; ++RoundIndex)
+	{
+		for(u32 TaskIndex = 0; TaskIndex < TaskCount; ++TaskIndex)
+		{
+			SDLAddEntry(Queue, QueueBenchmarkTask, Tasks + TaskIndex);
+		}
+		SDLCompleteAllWork(Queue);
+	}
+	double Seconds = double(SDL_GetPerformanceCounter() - Start) / PerformanceFrequency;
+	EndTemporaryMemory(TempMemory);
+
+	double TotalTasks = double(TaskCount) * double(RoundCount);
+	printf("Queue benchmark: %u threads, %u tasks x %u rounds\n", Queue->DequeCount, TaskCount, RoundCount);
+	printf("\t%.3f Mtasks/s, %.1f ns per task, serial work %.1f ns per task\n",
+			TotalTasks / (1000000.0 * Seconds),
+			1e9 * Seconds / TotalTasks,
+			1e9 * SerialSeconds / double(TaskCount));
+}
+
+// NOTE(hugo): Time per call and worst error of the three precisions
+// of Normalized, on random vectors of very different lengths. Each
+// input depends on the previous normal, as along a path, so that the
+// time is the latency of one call and not the throughput of a loop
+// the compiler could vectorise.
+internal void
+RunNormalizeBenchmark(memory_arena* Arena, u32 Iterations)
+{
+	u32 VectorCount = 1 << 16;
+	temporary_memory TempMemory = BeginTemporaryMemory(Arena);
+	v3* Vectors = PushArray(Arena, VectorCount, v3, Align(64, false));
+	v3* Normals = PushArray(Arena, VectorCount, v3, Align(64, false));
+
+	random_series Series = RandomSeed(1234, 1235);
+	for(u32 VectorIndex = 0; VectorIndex < VectorCount; ++VectorIndex)
+	{
+		float Scale = RandomBetween(&Series, 0.001f, 1000.0f);
+		Vectors[VectorIndex] = Scale * V3(RandomBetween(&Series, -1.0f, 1.0f),
+				RandomBetween(&Series, -1.0f, 1.0f), RandomBetween(&Series, -1.0f, 1.0f));
+	}
+
+	printf("Normalize benchmark: %u vectors x %u iterations\n", VectorCount, Iterations);
+	double PerformanceFrequency = double(SDL_GetPerformanceFrequency());
+	double CallCount = double(VectorCount) * double(Iterations);
+	char* Names[] = {"exact", "fast", "approx"};
+	for(u32 ModeIndex = 0; ModeIndex < ArrayCount(Names); ++ModeIndex)
+	{
+		u64 Start = SDL_GetPerformanceCounter();
+		for(u32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			v3 N = V3(1.0f, 0.0f, 0.0f);
+			for(u32 VectorIndex = 0; VectorIndex < VectorCount; ++VectorIndex)
+			{
+				v3 A = Vectors[VectorIndex] + N;
+				switch(ModeIndex)
+				{
+					case 0:
+						{
+							N = Normalized(A);
+						} break;
+					case 1:
+						{
+							N = NormalizedFast(A);
+						} break;
+					case 2:
+						{
+							N = NormalizedApprox(A);
+						} break;
+					InvalidDefaultCase;
+				}
+				Normals[VectorIndex] = N;
+			}
+		}
+		double Seconds = double(SDL_GetPerformanceCounter() - Start) / PerformanceFrequency;
+
+		// NOTE(hugo): Error against the normal computed in double.
+		double MaxError = 0.0;
+		v3 Previous = V3(1.0f, 0.0f, 0.0f);
+		for(u32 VectorIndex = 0; VectorIndex < VectorCount; ++VectorIndex)
+		{
+			v3 A = Vectors[VectorIndex] + Previous;
+			v3 N = Normals[VectorIndex];
+			double Length = sqrt(double(A.x) * double(A.x) + double(A.y) * double(A.y) + double(A.z) * double(A.z));
+			double Error = fabs(double(N.x) - double(A.x) / Length);
+			Error = fmax(Error, fabs(double(N.y) - double(A.y) / Length));
+			Error = fmax(Error, fabs(double(N.z) - double(A.z) / Length));
+			MaxError = fmax(MaxError, Error);
+			Previous = N;
+		}
+		printf("\tNormalized %-8s %.2f ns per call, max error %.2e\n", Names[ModeIndex],
+				1e9 * Seconds / CallCount, MaxError);
+	}
+
+	EndTemporaryMemory(TempMemory);
+}
+
+int main(int ArgumentCount, char** Arguments)
+{
+#if RAY_PROFILE
+	profile_snapshot ProfileStart = TakeProfileSnapshot();
+	u32 ProfileFirstPass = 0;
+#endif
 	render_state RenderState = {};
+	RenderState.Config = DefaultRenderConfig();
+	if(!ParseCommandLine(&RenderState.Config, ArgumentCount, Arguments))
+	{
+		return(1);
+	}
+	render_config* Config = &RenderState.Config;
+	u32 PixelCount = Config->Width * Config->Height;
+
+	// NOTE(hugo): In headless mode no window is ever created
+	// and the result is only written to disk once all the passes
+	// are done.
+	bool Headless = Config->Headless;
+
+	u32 SDLInitParams = Headless ? SDL_INIT_TIMER : SDL_INIT_EVERYTHING;
+	SDL_CHECK(SDL_Init(SDLInitParams));
 
+	printf("Cache line size = %dB\n", SDL_GetCPUCacheLineSize());
+
+	SDL_Window* Window = 0;
+	u32* ScreenPixels = 0;
+	if(!Headless)
 	{
-		memory_index ArenaSize = Gigabytes(2);
-		void* ArenaBase = Allocate_(ArenaSize);
-		InitialiseArena(&RenderState.Arena, ArenaSize, ArenaBase);
+		u32 WindowFlags = SDL_WINDOW_SHOWN;
+		Window = SDL_CreateWindow("PathTracer", 
+				SDL_WINDOWPOS_UNDEFINED,
+				SDL_WINDOWPOS_UNDEFINED,
+				Config->Width, Config->Height,
+				WindowFlags);
+
+		Assert(Window);
+
+		SDL_Surface* Screen = SDL_GetWindowSurface(Window);
+		Assert(Screen);
+		ScreenPixels = (u32*)(Screen->pixels);
 	}
-	//RenderState.Camera.P = V3(0.0f, 0.0f, 10.0f);
-	//RenderState.Camera.P = V3(0.0f, 1.5f, 5.0f);
-	RenderState.Camera.P = V3(0.0f, 1.0f, 2.5f);
-	RenderState.Camera.XAxis = V3(1.0f, 0.0f, 0.0f);
-	RenderState.Camera.ZAxis = V3(0.0f, 0.0f, 1.0f);
-	RenderState.FoV = Radians(75.0f);
-	RenderState.FocalLength = 2.0f;
-	RenderState.AspectRatio = float(GlobalWindowHeight) / float(GlobalWindowWidth);
+
+	// NOTE(hugo): Only address space, memory is committed as the arenas fill.
+	SetArenaMemoryBudget((Config->MemoryBudgetMB > 0) ?
+			memory_index(Megabytes(Config->MemoryBudgetMB)) : GetPhysicalMemorySize());
+	InitialiseVirtualArena(&RenderState.Arena, Gigabytes(64));
+	InitialiseVirtualArena(&RenderState.SceneArena, Gigabytes(64),
+			Config->HugePages ? ArenaReserve_HugePages : ArenaReserve_None);
+	InitialiseVirtualArena(&RenderState.SphereArena, Gigabytes(1));
+	SetArenaTag(&RenderState.SphereArena, MemoryTag_Spheres);
+	RenderState.Spheres = (sphere *)RenderState.SphereArena.Base;
+	InitialiseVirtualArena(&RenderState.MaterialArena, Gigabytes(1));
+	SetArenaTag(&RenderState.MaterialArena, MemoryTag_Materials);
+	RenderState.Materials = (material *)RenderState.MaterialArena.Base;
+	InitialiseVirtualArena(&RenderState.TileArena, Gigabytes(1));
+	SetArenaTag(&RenderState.TileArena, MemoryTag_Tiles);
+	RenderState.ShootRayChunkPool = (shoot_ray_block_data *)RenderState.TileArena.Base;
+	RenderState.Camera.P = Config->CameraP;
+	RenderState.Camera.XAxis = Normalized(Config->CameraXAxis);
+	RenderState.Camera.ZAxis = Normalized(Config->CameraZAxis);
+	RenderState.FoV = Radians(Config->FoVDegrees);
+	RenderState.FocalLength = Config->FocalLength;
+	RenderState.AspectRatio = float(Config->Height) / float(Config->Width);
 
 	RenderState.PersistentRenderValue.ScreenWidth = 2.0f * RenderState.FocalLength * Tan(0.5f * RenderState.FoV);
 	RenderState.PersistentRenderValue.ScreenHeight = RenderState.PersistentRenderValue.ScreenWidth * RenderState.AspectRatio;
 	RenderState.PersistentRenderValue.CameraYAxis = Cross(RenderState.Camera.ZAxis, RenderState.Camera.XAxis);
 
-	RenderState.Entropy = RandomSeed(1234, 1235);
+	RenderState.Entropy = RandomSeed(Config->Seed, Config->Seed + 1);
 
-	//RenderState.Trees = PushArray(&RenderState.Arena, RenderState.TreeMaxPoolCount, kdtree);
-	RenderState.TreeCount = 0;
-	//LoadKDTreeFromFile("../data/teapot_with_normal.obj", &RenderState);
-#define DATA_FOLDER(Filename) "../data/" Filename
-	LoadKDTreeFromFile(DATA_FOLDER("CornellBox/CornellBox-Original-WithNormals.obj"), DATA_FOLDER("CornellBox"), &RenderState);
+	// NOTE(hugo): Opened before the workers exist so that it counts them too.
+	cache_miss_counter CacheMissCounter = {};
+	bool CountCacheMisses = false;
+	if(Config->CountCacheMisses)
+	{
+		CountCacheMisses = OpenCacheMissCounter(&CacheMissCounter);
+		if(!CountCacheMisses)
+		{
+			printf("Cache miss counter unavailable (no perf events on this system).\n");
+		}
+	}
 
-	RenderState.ShootRayChunkCount = 0;
+	// NOTE(hugo): Multithreading init
+	// {
+	SetArenaTag(&RenderState.Arena, MemoryTag_Scheduler);
+	cpu_topology Topology = QueryCPUTopology(&RenderState.Arena);
+	SortCPUsForPinning(&Topology, Config->Pinning);
+	printf("%u logical CPUs, %u physical cores, %u NUMA nodes\n",
+			Topology.LogicalCount, Topology.PhysicalCoreCount, Topology.NodeCount);
+	if(Config->ThreadCount == 0)
+	{
+		// NOTE(hugo): The main thread works too while waiting for a pass.
+		Config->ThreadCount = Maxu(1, Topology.LogicalCount - 1);
+	}
+
+	bool Pinned = (Config->Pinning != ThreadPinning_None);
+	if(Pinned)
+	{
+		PinCurrentThreadToCPU(Topology.CPUs[0].ID);
+	}
+
+	RenderState.Queue = {};
+	sdl_thread_startup* Startups = PushArray(&RenderState.Arena, Config->ThreadCount, sdl_thread_startup, Align(64, true));
+	for(u32 ThreadIndex = 0; ThreadIndex < Config->ThreadCount; ++ThreadIndex)
+	{
+		logical_cpu* CPU = Topology.CPUs + ((ThreadIndex + 1) % Topology.LogicalCount);
+		Startups[ThreadIndex].PinnedCPU = Pinned ? s32(CPU->ID) : -1;
+	}
+	if(Config->TracePath[0] != '\0')
+	{
+		SetArenaTag(&RenderState.Arena, MemoryTag_Trace);
+		InitialiseTrace(&RenderState.Arena, Config->ThreadCount + 1);
+		SetArenaTag(&RenderState.Arena, MemoryTag_Scheduler);
+	}
+	SDLMakeQueue(&RenderState.Queue, Config->ThreadCount, Startups, &RenderState.Arena);
+	printf("%u worker threads\n", Config->ThreadCount);
+	// }
 
-	v3* Backbuffer = PushArray(&RenderState.Arena, GlobalWindowWidth * GlobalWindowHeight, v3);
+	// NOTE(hugo): The scene is loaded once the workers exist,
+	// the LBVH builder runs on them.
+	//RenderState.Trees = PushArray(&RenderState.Arena, RenderState.TreeMaxPoolCount, kdtree);
+	RenderState.TreeCount = 0;
+	u64 LoadStart = SDL_GetPerformanceCounter();
+	LoadKDTreeFromFile(Config->ScenePath, Config->MaterialPath, &RenderState);
+	// NOTE(hugo): Parsing the file and preparing the triangles, without the tree build.
+	double SceneLoadMS = 1000.0 * double(SDL_GetPerformanceCounter() - LoadStart) /
+		double(SDL_GetPerformanceFrequency()) - RenderState.TreeBuildMS;
+
+	CreateTiles(&RenderState, Config->ChunkWidth, Config->ChunkHeight);
+
+	SetArenaTag(&RenderState.Arena, MemoryTag_Framebuffers);
+	v3* Backbuffer = PushArray(&RenderState.Arena, PixelCount, v3, Align(64, true));
+#if RAY_TRAVERSAL_STATS
+	SetArenaTag(&RenderState.Arena, MemoryTag_Stats);
+	RenderState.PixelTraversalStats = PushArray(&RenderState.Arena, PixelCount, traversal_stats, Align(64, true));
+#endif
+	RenderState.Backbuffer = Backbuffer;
+	SetArenaTag(&RenderState.Arena, MemoryTag_PassBuffers);
+	RenderState.PassBuffers[0] = PushArray(&RenderState.Arena, PixelCount, v3, Align(64, false));
+	RenderState.PassBuffers[1] = PushArray(&RenderState.Arena, PixelCount, v3, Align(64, false));
+	SetArenaTag(&RenderState.Arena, MemoryTag_Framebuffers);
+	v3* PreviousScreen = 0;
 #if RAY_COMPUTE_VARIATION
-	v3* PreviousScreen = PushArray(&RenderState.Arena, GlobalWindowWidth * GlobalWindowHeight, v3);
+	if(!Headless)
+	{
+		PreviousScreen = PushArray(&RenderState.Arena, PixelCount, v3);
+	}
 #endif
+	if(Headless)
+	{
+		ScreenPixels = PushArray(&RenderState.Arena, PixelCount, u32);
+	}
 
-	// NOTE(hugo): Multithreading init
-	RenderState.Queue = {};
-	sdl_thread_startup Startups[4] = {};
-	SDLMakeQueue(&RenderState.Queue, ArrayCount(Startups), Startups);
+	RenderState.Wavefront = 0;
+	if(Config->Integrator == Integrator_Wavefront)
+	{
+		SetArenaTag(&RenderState.Arena, MemoryTag_Wavefront);
+		RenderState.Wavefront = CreateWavefrontState(&RenderState, Config->WavefrontBatchSize);
+		RenderState.Wavefront->CacheMissCounter = CountCacheMisses ? &CacheMissCounter : 0;
+	}
+	SetArenaTag(&RenderState.Arena, MemoryTag_Other);
+
+	if(Config->QueueBenchmarkTaskCount > 0)
+	{
+		RunQueueBenchmark(&RenderState.Queue, Config->QueueBenchmarkTaskCount, &RenderState.Arena);
+		SDLStopQueue(&RenderState.Queue);
+		return(0);
+	}
+
+	if(Config->ResolveBenchmarkIterations > 0)
+	{
+		RunResolveBenchmark(&RenderState.Queue, &RenderState.Arena, PixelCount,
+				Config->ResolveBenchmarkIterations, Config->Tonemap);
+		SDLStopQueue(&RenderState.Queue);
+		return(0);
+	}
+
+	if(Config->NormalizeBenchmarkIterations > 0)
+	{
+		RunNormalizeBenchmark(&RenderState.Arena, Config->NormalizeBenchmarkIterations);
+		SDLStopQueue(&RenderState.Queue);
+		return(0);
+	}
+
+	if(Config->BuildBenchmarkIterations > 0)
+	{
+		RunBuildBenchmark(&RenderState, Config->BuildBenchmarkIterations);
+		SDLStopQueue(&RenderState.Queue);
+		return(0);
+	}
+
+	if(Config->RefitBenchmarkFrames > 0)
+	{
+		RunRefitBenchmark(&RenderState, Config->RefitBenchmarkFrames);
+		SDLStopQueue(&RenderState.Queue);
+		return(0);
+	}
+
+	memory_arena* MainArenas[] = {&RenderState.Arena, &RenderState.SceneArena,
+		&RenderState.SphereArena, &RenderState.MaterialArena, &RenderState.TileArena};
+	char* MainArenaNames[] = {"render", "scene", "spheres", "materials", "tiles"};
+	PrintMemoryReport("at startup", MainArenas, MainArenaNames, ArrayCount(MainArenas), RenderState.TriangleCount);
 
 #if 0
 	PushMaterial(&RenderState, {V3(0.8f, 0.2f, 0.1f), 0.5f, 0.9f});
@@ -485,15 +1052,33 @@ int main(int ArgumentCount, char** Arguments)
 #endif
 
 	u32 CurrentAAIndex = 0;
+	u32 AACount = Config->PassCount;
+	u32 SampleCount = 0;
+	u64 TotalRayCount = 0;
+	double TotalElapsedMS = 0.0;
 
 	double PerformanceFrequency = double(SDL_GetPerformanceFrequency());
+	u64 PassStartCounter = 0;
+
+	// NOTE(hugo): There is always one pass in flight. As soon as it
+	// is done the next one is queued, then the finished one is
+	// accumulated and presented while the workers render.
+	bool PassInFlight = false;
+	u32 PassParity = 0;
+	if(AACount > 0)
+	{
+		printf("Rendering pass %i\n", CurrentAAIndex);
+		PassStartCounter = SDL_GetPerformanceCounter();
+		RenderBackbuffer(&RenderState, PassParity);
+		PassInFlight = true;
+	}
 
 	while(GlobalRunning)
 	{
 		// NOTE(hugo): Input
 		// {
 		SDL_Event Event = {};
-		while(SDL_PollEvent(&Event))
+		while(!Headless && SDL_PollEvent(&Event))
 		{
 			switch(Event.type)
 			{
@@ -508,76 +1093,226 @@ int main(int ArgumentCount, char** Arguments)
 		}
 		// }
 
-		if(CurrentAAIndex < GlobalAACount)
+		if(PassInFlight)
 		{
-			printf("Rendering pass %i\n", CurrentAAIndex);
-			DEBUGRayCount = 0;
-			DEBUGCycleCountPass = SDL_GetPerformanceCounter();
-			RenderState.TempMemory = BeginTemporaryMemory(&RenderState.Arena);
-			RenderBackbuffer(&RenderState);
-
-			SDLCompleteAllWork(&RenderState.Queue);
-			for(u32 WorkIndex = 0; WorkIndex < RenderState.ShootRayChunkCount; ++WorkIndex)
-			{
-				shoot_ray_block_data* WorkData = RenderState.ShootRayChunkPool + WorkIndex;
+			SDLWaitForTaskGroup(&RenderState.Queue, RenderState.PassGroups + PassParity);
 
-				// NOTE(hugo): Gathering each chunk from every work and putting them into the Backbuffer
-				// {
-				for(u32 Y = 0; Y < GlobalChunkHeight; ++Y)
+			// NOTE(hugo): The tiles are read before the next pass reuses them.
+			u32 PassRayCount = 0;
+			u64 BusyCycles = 0;
+			if(RenderState.Wavefront)
+			{
+				PassRayCount = RenderState.Wavefront->RayCount;
+				BusyCycles = RenderState.Wavefront->BusyCycles;
+			}
+			else
+			{
+				for(u32 WorkIndex = 0; WorkIndex < RenderState.ShootRayChunkCount; ++WorkIndex)
 				{
-					for(u32 X = 0; X < GlobalChunkWidth; ++X)
-					{
-						v3* BackbufferPixel = Backbuffer
-							+ WorkData->ChunkStartX + X
-							+ (WorkData->ChunkStartY + Y) * GlobalWindowWidth;
-						v3* WorkDataPixel = WorkData->BackbufferChunk + X + Y * GlobalChunkWidth;
-						*BackbufferPixel += *WorkDataPixel;
-					}
+					PassRayCount += RenderState.ShootRayChunkPool[WorkIndex].RayCount;
+					BusyCycles += RenderState.ShootRayChunkPool[WorkIndex].Cycles;
 				}
-				// }
-				DEBUGRayCount += WorkData->RayCount;
 			}
-			EndTemporaryMemory(RenderState.TempMemory);
-			RenderState.ShootRayChunkCount = 0;
+			SampleCount += Config->SamplesPerTask;
 
 			{
-				u64 CurrentCycleCountPass = SDL_GetPerformanceCounter();
-				u64 CyclesPass = CurrentCycleCountPass - DEBUGCycleCountPass;
+				u64 PassEndCounter = SDL_GetPerformanceCounter();
+				u64 CyclesPass = PassEndCounter - PassStartCounter;
+				PassStartCounter = PassEndCounter;
 				double ElapsedMS = 1000.0f * double(CyclesPass) / PerformanceFrequency;
-				printf("\tPass %i rendered. %u rays. %fms. %f rays per ms.\n",
+				double Utilisation = double(BusyCycles) / (double(CyclesPass) * double(RenderState.Queue.DequeCount));
+				TotalRayCount += PassRayCount;
+				TotalElapsedMS += ElapsedMS;
+				if(Config->AutoTileSize)
+				{
+					AutoTuneTileSize(&RenderState, CyclesPass);
+				}
+				printf("\tPass %i rendered. %u rays. %fms. %f rays per ms. %.0f%% busy.\n",
 						CurrentAAIndex,
-						DEBUGRayCount, ElapsedMS, float(DEBUGRayCount) / ElapsedMS);
+						PassRayCount, ElapsedMS, float(PassRayCount) / ElapsedMS, 100.0 * Utilisation);
+#if RAY_TRAVERSAL_STATS
+				traversal_stats PassTraversalStats = {};
+				if(RenderState.Wavefront)
+				{
+					PassTraversalStats = RenderState.Wavefront->TraversalStats;
+				}
+				else
+				{
+					for(u32 WorkIndex = 0; WorkIndex < RenderState.ShootRayChunkCount; ++WorkIndex)
+					{
+						AddTraversalStats(&PassTraversalStats, RenderState.ShootRayChunkPool[WorkIndex].TraversalStats);
+					}
+				}
+				PrintTraversalStats(PassTraversalStats, PassRayCount);
+#endif
+				wavefront_state* Wavefront = RenderState.Wavefront;
+				if(Wavefront && Wavefront->SecondaryRayCount > 0)
+				{
+					double IntersectMS = 1000.0 * double(Wavefront->SecondaryIntersectCycles) / PerformanceFrequency;
+					printf("\tSecondary rays : %llu traced in %fms (%.3f Mrays/s)",
+							(unsigned long long)Wavefront->SecondaryRayCount, IntersectMS,
+							double(Wavefront->SecondaryRayCount) / (1000.0 * IntersectMS));
+					if(Wavefront->CacheMissCounter)
+					{
+						printf(", %.2f cache misses per ray",
+								double(Wavefront->SecondaryCacheMisses) / double(Wavefront->SecondaryRayCount));
+					}
+					printf(".\n");
+				}
 			}
 
 			++CurrentAAIndex;
 
-#if RAY_COMPUTE_VARIATION
-			float BufferVariation = 0.0f;
-#endif
-			for(u32 PixelIndex = 0; PixelIndex < GlobalWindowWidth * GlobalWindowHeight; ++PixelIndex)
+#if RAY_PROFILE
+			// NOTE(hugo): Nothing is in flight here, so the snapshot
+			// holds exactly the passes done so far (and the loading,
+			// for the first report).
+			if(Config->ProfileInterval > 0 &&
+					((CurrentAAIndex % Config->ProfileInterval) == 0 || CurrentAAIndex == AACount))
 			{
-				u32* Pixel = (u32*)(Screen->pixels) + PixelIndex;
-				v3 Color = Backbuffer[PixelIndex];
-				v3 SRGBColor = LinearToSRGB(Color / float(CurrentAAIndex));
-#if RAY_COMPUTE_VARIATION
-			{
-				BufferVariation += LengthSqr(SRGBColor - PreviousScreen[PixelIndex]);
-				PreviousScreen[PixelIndex] = SRGBColor;
+				profile_snapshot ProfileEnd = TakeProfileSnapshot();
+				char Label[64];
+				snprintf(Label, sizeof(Label), "passes %u-%u", ProfileFirstPass, CurrentAAIndex - 1);
+				PrintProfile(&ProfileStart, &ProfileEnd, Label);
+				ProfileStart = ProfileEnd;
+				ProfileFirstPass = CurrentAAIndex;
 			}
 #endif
-				*Pixel = RGBToPixel(SRGBColor);
+
+			u32 FinishedParity = PassParity;
+			PassInFlight = false;
+			if(CurrentAAIndex < AACount)
+			{
+				printf("Rendering pass %i\n", CurrentAAIndex);
+				PassParity = 1 - PassParity;
+				RenderBackbuffer(&RenderState, PassParity);
+				PassInFlight = true;
 			}
 
+			// NOTE(hugo): Headless runs only accumulate here, the
+			// pixels are resolved once at the end.
+			float BufferVariation = ResolveFramebuffer(&RenderState.Queue, &RenderState.Arena,
+					Backbuffer, RenderState.PassBuffers[FinishedParity],
+					Headless ? 0 : ScreenPixels, PreviousScreen,
+					PixelCount, SampleCount, Config->Tonemap);
+			if(!Headless)
+			{
 #if RAY_COMPUTE_VARIATION
-			printf("\tVariation = %f\n", BufferVariation);
+				printf("\tVariation = %f\n", BufferVariation);
 #endif
 
-			SDL_UpdateWindowSurface(Window);
+				TIMED_BLOCK(Present);
+				SDL_UpdateWindowSurface(Window);
+			}
 			GlobalComputed = true;
 		}
+		else if(Headless)
+		{
+			GlobalRunning = false;
+		}
+	}
+
+	double ReferenceRMSE = -1.0;
+	if(Headless)
+	{
+		ResolveFramebuffer(&RenderState.Queue, &RenderState.Arena,
+				Backbuffer, 0, ScreenPixels, 0,
+				PixelCount, SampleCount, Config->Tonemap);
+
+		if(Config->ReferencePath[0] != '\0')
+		{
+			temporary_memory TempMemory = BeginTemporaryMemory(&RenderState.Arena);
+			v3* Reference = PushArray(&RenderState.Arena, PixelCount, v3);
+			if(ReadPFM(Config->ReferencePath, Config->Width, Config->Height, Reference))
+			{
+				ReferenceRMSE = ClampedRMSE(Backbuffer, 1.0f / float(SampleCount), Reference, PixelCount);
+				printf("RMSE against %s : %f\n", Config->ReferencePath, ReferenceRMSE);
+			}
+			else
+			{
+				printf("Could not read the reference %s (missing, or not %ux%u).\n",
+						Config->ReferencePath, Config->Width, Config->Height);
+			}
+			EndTemporaryMemory(TempMemory);
+		}
+
+		TIMED_BLOCK(Present);
+		char Filename[CONFIG_PATH_SIZE + 8];
+		snprintf(Filename, sizeof(Filename), "%s.pfm", Config->OutputPath);
+		WritePFM(Filename, Config->Width, Config->Height, Backbuffer, 1.0f / float(SampleCount));
+		snprintf(Filename, sizeof(Filename), "%s.ppm", Config->OutputPath);
+		WritePPM(Filename, Config->Width, Config->Height, ScreenPixels);
+		printf("Wrote %s.pfm and %s.ppm\n", Config->OutputPath, Config->OutputPath);
+	}
+
+	// NOTE(hugo): A window closed during a pass leaves it in flight.
+	if(PassInFlight)
+	{
+		SDLWaitForTaskGroup(&RenderState.Queue, RenderState.PassGroups + PassParity);
+	}
+
+	// NOTE(hugo): After the final resolve, the last work of the queue.
+	if(Config->TracePath[0] != '\0')
+	{
+		WriteChromeTrace(Config->TracePath);
 	}
 
-	SDL_DestroyWindow(Window);
+#if RAY_PROFILE
+	if(Config->ProfileInterval > 0 && Headless)
+	{
+		profile_snapshot ProfileEnd = TakeProfileSnapshot();
+		PrintProfile(&ProfileStart, &ProfileEnd, "the final resolve and output");
+	}
+#endif
+
+#if RAY_TRAVERSAL_STATS
+	// NOTE(hugo): Only the scalar path integrator fills the per pixel stats.
+	if(Config->Integrator == Integrator_Path && Config->PacketSize == 0)
+	{
+		WriteTraversalHeatmaps(Config->OutputPath, RenderState.PixelTraversalStats,
+				Config->Width, Config->Height, SampleCount, &RenderState.Arena);
+	}
+	else
+	{
+		printf("Traversal heatmaps need the path integrator without packets.\n");
+	}
+#endif
+
+	PrintMemoryReport("at exit", MainArenas, MainArenaNames, ArrayCount(MainArenas), RenderState.TriangleCount);
+	memory_index UsedBytes = 0;
+	memory_index CommittedBytes = 0;
+	for(u32 ArenaIndex = 0; ArenaIndex < ArrayCount(MainArenas); ++ArenaIndex)
+	{
+		UsedBytes += MainArenas[ArenaIndex]->Used;
+		CommittedBytes += MainArenas[ArenaIndex]->Committed;
+	}
+	for(u32 DequeIndex = 0; DequeIndex < RenderState.Queue.DequeCount; ++DequeIndex)
+	{
+		char Name[32];
+		snprintf(Name, sizeof(Name), "scratch %u", DequeIndex);
+		memory_arena* Scratch = &RenderState.Queue.Scratches[DequeIndex].Arena;
+		PrintArenaUsage(Name, Scratch);
+		CommittedBytes += Scratch->Committed;
+	}
+
+	// NOTE(hugo): One line per run, easy to grep from a sweep script.
+	// NOTE(hugo): rmse is -1 without a reference.
+	printf("Summary: scene=%s width=%u height=%u tile=%ux%u threads=%u passes=%u spp=%u rays=%llu ms=%.1f Mrays/s=%.3f "
+			"load_ms=%.1f build_ms=%.1f arena_mb=%.1f committed_mb=%.1f peak_rss_mb=%.1f rmse=%.6f\n",
+			Config->ScenePath, Config->Width, Config->Height,
+			RenderState.ChunkWidth, RenderState.ChunkHeight, Config->ThreadCount,
+			CurrentAAIndex, SampleCount, (unsigned long long)TotalRayCount, TotalElapsedMS,
+			(TotalElapsedMS > 0.0) ? (double(TotalRayCount) / (1000.0 * TotalElapsedMS)) : 0.0,
+			SceneLoadMS, RenderState.TreeBuildMS,
+			double(UsedBytes) / double(Megabytes(1)),
+			double(CommittedBytes) / double(Megabytes(1)),
+			double(GetPeakResidentBytes()) / double(Megabytes(1)), ReferenceRMSE);
+
+	if(Window)
+	{
+		SDL_DestroyWindow(Window);
+	}
+	SDLStopQueue(&RenderState.Queue);
 	SDL_Quit();
 	return(0);
 }
@@ -0,0 +1,282 @@
+#pragma once
+
+/* NOTE(hugo)
+ *    Refit of the scene tree for meshes whose vertices move but whose
+ *    triangles stay the same (skinned or simulated meshes) : every
+ *    leaf keeps its triangles, only the boxes are computed again from
+ *    the new vertex positions, from the leaves up, on the worker pool
+ *    (PropagateBoxesUp, as in LBVHComputeBounds).
+ *
+ *    A refitted tree gets worse as the vertices move away from where
+ *    it was built : boxes grow and overlap. Its quality is the SAH cost
+ *    of the tree, and RefitSceneTree rebuilds it from scratch once that
+ *    cost is more than RefitRebuildRatio times the one right after its
+ *    build.
+ */
+
+#define REFIT_MIN_LEAVES_PER_TASK 1024
+
+struct refit_state;
+struct refit_task
+{
+	refit_state* Refit;
+	u32 First;
+	u32 OnePastLast;
+	// NOTE(hugo): SAH cost of the nodes this task finished,
+	// not yet divided by the area of the root.
+	float Cost;
+};
+
+struct refit_state
+{
+	// NOTE(hugo): Holds everything below, cleared on a rebuild
+	// since the node count can change.
+	memory_arena Arena;
+
+	kdtree* Nodes;
+	vertex* Vertices;
+	// NOTE(hugo): Parent of every node reached from the root : the
+	// nodes left in the pool under an LBVH leaf are not.
+	u32* Parents;
+	u32* Children;
+	u32 volatile* Visits;
+	u32 NodeCount;
+	u32 LeafCount;
+	u32* Leaves;
+
+	u32 TaskCount;
+	refit_task* Tasks;
+
+	// NOTE(hugo): SAH cost of the tree right after its build, and the
+	// one of the last refit over it, measured before any rebuild.
+	float BuildCost;
+	float CostRatio;
+	u32 RefitCount;
+	u32 RebuildCount;
+};
+
+// NOTE(hugo): One task per range of leaves. A leaf boxes its triangles
+// at their new positions, then goes up with PropagateBoxesUp.
+PLATFORM_WORK_QUEUE_CALLBACK(RefitLeaves)
+{
+	refit_task* Task = (refit_task *)Data;
+	refit_state* Refit = Task->Refit;
+	kdtree* Nodes = Refit->Nodes;
+	vertex* Vertices = Refit->Vertices;
+
+	float Cost = 0.0f;
+	for(u32 LeafIndex = Task->First; LeafIndex < Task->OnePastLast; ++LeafIndex)
+	{
+		u32 NodeIndex = Refit->Leaves[LeafIndex];
+		kdtree* Leaf = Nodes + NodeIndex;
+		rect3 Box = {V3(MAX_REAL, MAX_REAL, MAX_REAL), V3(MIN_REAL, MIN_REAL, MIN_REAL)};
+		for(u32 TriangleIndex = 0; TriangleIndex < Leaf->TriangleCount; ++TriangleIndex)
+		{
+			triangle* Triangle = Leaf->Triangles + TriangleIndex;
+			for(u32 VertexIndex = 0; VertexIndex < 3; ++VertexIndex)
+			{
+				v3 P = Vertices[Triangle->Indices[VertexIndex]].P;
+				Box.Min = V3(Minf(Box.Min.x, P.x), Minf(Box.Min.y, P.y), Minf(Box.Min.z, P.z));
+				Box.Max = V3(Maxf(Box.Max.x, P.x), Maxf(Box.Max.y, P.y), Maxf(Box.Max.z, P.z));
+			}
+		}
+		Leaf->BoundingBox = Box;
+		Cost += SAHNodeCost(Leaf);
+
+		PropagateBoxesUp(Nodes, NodeIndex, Refit->Parents, Refit->Children, Refit->Visits, &Cost);
+	}
+	Task->Cost = Cost;
+}
+
+// NOTE(hugo): Walks the tree once to find the parent of every node and
+// the leaves, in depth-first order so that a task refits neighbouring
+// leaves, and takes the current boxes as the ones of the build.
+internal void
+PrepareRefit(refit_state* Refit, render_state* RenderState)
+{
+	memory_arena* Arena = &Refit->Arena;
+	ClearArena(Arena);
+
+	u32 PoolCount = RenderState->TreeCount;
+	Refit->Nodes = RenderState->Trees;
+	Refit->Vertices = RenderState->Vertices;
+	Refit->Parents = PushArray(Arena, PoolCount, u32, Align(64, false));
+	Refit->Children = PushArray(Arena, 2 * PoolCount, u32, Align(64, false));
+	Refit->Visits = PushArray(Arena, PoolCount, u32, Align(64, true));
+	Refit->Leaves = PushArray(Arena, PoolCount, u32, Align(64, false));
+	Refit->NodeCount = 0;
+	Refit->LeafCount = 0;
+
+	float Cost = 0.0f;
+	temporary_memory WalkMemory = BeginTemporaryMemory(Arena);
+	u32* Stack = PushArray(Arena, PoolCount, u32, NoClear());
+	u32 StackCount = 0;
+	Stack[StackCount++] = 0;
+	Refit->Parents[0] = KD_TREE_NO_CHILD;
+	while(StackCount > 0)
+	{
+		u32 NodeIndex = Stack[--StackCount];
+		kdtree* Node = Refit->Nodes + NodeIndex;
+		++Refit->NodeCount;
+		Cost += SAHNodeCost(Node);
+		if(Node->LeftIndex == KD_TREE_NO_CHILD)
+		{
+			Refit->Leaves[Refit->LeafCount++] = NodeIndex;
+		}
+		else
+		{
+			Assert(Node->RightIndex != KD_TREE_NO_CHILD);
+			Refit->Parents[Node->RightIndex] = NodeIndex;
+			Refit->Parents[Node->LeftIndex] = NodeIndex;
+			Refit->Children[2 * NodeIndex + 0] = Node->LeftIndex;
+			Refit->Children[2 * NodeIndex + 1] = Node->RightIndex;
+			Stack[StackCount++] = Node->RightIndex;
+			Stack[StackCount++] = Node->LeftIndex;
+		}
+	}
+	EndTemporaryMemory(WalkMemory);
+
+	float RootArea = RectSurfaceArea(Refit->Nodes[0].BoundingBox);
+	Refit->BuildCost = (RootArea > 0.0f) ? Cost / RootArea : 0.0f;
+
+	platform_work_queue* Queue = &RenderState->Queue;
+	u32 TaskCount = (Refit->LeafCount + REFIT_MIN_LEAVES_PER_TASK - 1) / REFIT_MIN_LEAVES_PER_TASK;
+	TaskCount = Maxu(1, Minu(TaskCount, 4 * Queue->DequeCount));
+	u32 LeavesPerTask = (Refit->LeafCount + TaskCount - 1) / TaskCount;
+	Refit->TaskCount = TaskCount;
+	Refit->Tasks = PushArray(Arena, TaskCount, refit_task, Align(64, true));
+	for(u32 TaskIndex = 0; TaskIndex < TaskCount; ++TaskIndex)
+	{
+		refit_task* Task = Refit->Tasks + TaskIndex;
+		Task->Refit = Refit;
+		Task->First = Minu(Refit->LeafCount, TaskIndex * LeavesPerTask);
+		Task->OnePastLast = Minu(Refit->LeafCount, Task->First + LeavesPerTask);
+	}
+}
+
+internal void
+InitialiseRefit(refit_state* Refit, render_state* RenderState)
+{
+	*Refit = {};
+	InitialiseVirtualArena(&Refit->Arena, Gigabytes(1));
+	PrepareRefit(Refit, RenderState);
+	Refit->CostRatio = 1.0f;
+}
+
+// NOTE(hugo): To call once the vertices of RenderState moved. Returns
+// true when the refitted tree was too poor and got rebuilt instead.
+internal bool
+RefitSceneTree(refit_state* Refit, render_state* RenderState)
+{
+	Assert(Refit->Nodes == RenderState->Trees);
+	platform_work_queue* Queue = &RenderState->Queue;
+	platform_task_group Group = {};
+	for(u32 TaskIndex = 0; TaskIndex < Refit->TaskCount; ++TaskIndex)
+	{
+		SDLAddEntry(Queue, &Group, RefitLeaves, Refit->Tasks + TaskIndex);
+	}
+	SDLWaitForTaskGroup(Queue, &Group);
+	++Refit->RefitCount;
+
+	float Cost = 0.0f;
+	for(u32 TaskIndex = 0; TaskIndex < Refit->TaskCount; ++TaskIndex)
+	{
+		Cost += Refit->Tasks[TaskIndex].Cost;
+	}
+	float RootArea = RectSurfaceArea(Refit->Nodes[0].BoundingBox);
+	Cost = (RootArea > 0.0f) ? Cost / RootArea : 0.0f;
+	Refit->CostRatio = (Refit->BuildCost > 0.0f) ? Cost / Refit->BuildCost : 1.0f;
+
+	bool Rebuilt = false;
+	if(Refit->CostRatio > RenderState->Config.RefitRebuildRatio)
+	{
+		// NOTE(hugo): The refit left the box of the
+		// new vertices in the root, the build starts from it.
+		ResetSceneTree(RenderState);
+		BuildSceneTree(RenderState->Trees, RenderState);
+		PrepareRefit(Refit, RenderState);
+		++Refit->RebuildCount;
+		Rebuilt = true;
+	}
+
+	return(Rebuilt);
+}
+
+// NOTE(hugo): Twists the scene around the vertical axis through its
+// centre, more every frame and more at the top than at the bottom,
+// and refits the tree after each frame. The vertices are put back
+// in place at the end. The normals are left as they are, nothing
+// is rendered.
+internal void
+RunRefitBenchmark(render_state* RenderState, u32 FrameCount)
+{
+	memory_arena* Arena = &RenderState->Arena;
+	temporary_memory BenchMemory = BeginTemporaryMemory(Arena);
+	u32 VertexCount = RenderState->VertexCount;
+	vertex* Vertices = RenderState->Vertices;
+	v3* RestPositions = PushArray(Arena, VertexCount, v3, NoClear());
+	for(u32 VertexIndex = 0; VertexIndex < VertexCount; ++VertexIndex)
+	{
+		RestPositions[VertexIndex] = Vertices[VertexIndex].P;
+	}
+	rect3 RestBox = RenderState->Trees[0].BoundingBox;
+	v3 Centre = 0.5f * (RestBox.Min + RestBox.Max);
+	float Height = Maxf(RestBox.Max.y - RestBox.Min.y, 1e-6f);
+
+	refit_state Refit;
+	InitialiseRefit(&Refit, RenderState);
+	printf("Refit benchmark: %u triangles, %u nodes, %u leaves, SAH cost %.2f, rebuild past %.2fx\n",
+			RenderState->TriangleCount, Refit.NodeCount, Refit.LeafCount, Refit.BuildCost,
+			RenderState->Config.RefitRebuildRatio);
+
+	double PerformanceFrequency = double(SDL_GetPerformanceFrequency());
+	double RefitSeconds = 0.0;
+	double BestRefitSeconds = MAX_FLOAT32;
+	double RebuildSeconds = 0.0;
+	float WorstRatio = 1.0f;
+	for(u32 Frame = 1; Frame <= FrameCount; ++Frame)
+	{
+		// NOTE(hugo): Up to a quarter turn between the bottom
+		// and the top of the scene after 64 frames.
+		float Twist = 0.5f * PI * float(Frame) / 64.0f;
+		for(u32 VertexIndex = 0; VertexIndex < VertexCount; ++VertexIndex)
+		{
+			v3 P = RestPositions[VertexIndex] - Centre;
+			float Angle = Twist * (P.y + 0.5f * Height) / Height;
+			float C = cosf(Angle);
+			float S = sinf(Angle);
+			Vertices[VertexIndex].P = Centre + V3(C * P.x + S * P.z, P.y, -S * P.x + C * P.z);
+		}
+
+		u64 Start = SDL_GetPerformanceCounter();
+		bool Rebuilt = RefitSceneTree(&Refit, RenderState);
+		double Seconds = double(SDL_GetPerformanceCounter() - Start) / PerformanceFrequency;
+		if(Rebuilt)
+		{
+			RebuildSeconds += Seconds;
+			printf("\tframe %u : SAH cost %.2fx the one of the build, rebuilt\n", Frame, Refit.CostRatio);
+		}
+		else
+		{
+			RefitSeconds += Seconds;
+			if(Seconds < BestRefitSeconds)
+			{
+				BestRefitSeconds = Seconds;
+			}
+			WorstRatio = Maxf(WorstRatio, Refit.CostRatio);
+		}
+	}
+
+	for(u32 VertexIndex = 0; VertexIndex < VertexCount; ++VertexIndex)
+	{
+		Vertices[VertexIndex].P = RestPositions[VertexIndex];
+	}
+	EndTemporaryMemory(BenchMemory);
+
+	u32 RefitOnlyCount = Refit.RefitCount - Refit.RebuildCount;
+	printf("\t%u refits : %.3f ms per refit (best %.3f ms), worst SAH cost %.2fx the one of the build\n",
+			RefitOnlyCount, (RefitOnlyCount > 0) ? 1000.0 * RefitSeconds / double(RefitOnlyCount) : 0.0,
+			(RefitOnlyCount > 0) ? 1000.0 * BestRefitSeconds : 0.0, WorstRatio);
+	printf("\t%u rebuilds : %.3f ms per refit and rebuild\n", Refit.RebuildCount,
+			(Refit.RebuildCount > 0) ? 1000.0 * RebuildSeconds / double(Refit.RebuildCount) : 0.0);
+}
@@ -0,0 +1,332 @@
+#pragma once
+
+// NOTE(hugo): Resolve stage : adds the last pass into the accumulation
+// buffer, divides by the sample count, tonemaps, gamma-corrects and
+// packs to ARGB8. The framebuffer is cut in bands that run as tasks on
+// the work queue, each band being processed four pixels at a time with
+// SSE (the three channels of four pixels are deinterleaved into one
+// register per channel).
+
+enum tonemap_operator
+{
+	Tonemap_None,
+	Tonemap_Reinhard,
+	Tonemap_ACES,
+};
+
+struct resolve_task
+{
+	v3* Backbuffer;
+	// NOTE(hugo): Each of those can be null to skip the matching step :
+	// no accumulation, no display pixels, no variation.
+	v3* PassBuffer;
+	u32* Pixels;
+	v3* PreviousScreen;
+
+	u32 FirstPixel;
+	u32 PixelCount;
+	float InvSampleCount;
+	tonemap_operator Tonemap;
+
+	float Variation;
+};
+
+inline float
+TonemapChannel(float C, tonemap_operator Tonemap)
+{
+	float Result = C;
+	switch(Tonemap)
+	{
+		case Tonemap_None:
+			{
+			} break;
+		case Tonemap_Reinhard:
+			{
+				Result = C / (1.0f + C);
+			} break;
+		case Tonemap_ACES:
+			{
+				// NOTE(hugo): Krzysztof Narkowicz's fit of the ACES curve.
+				Result = (C * (2.51f * C + 0.03f)) / (C * (2.43f * C + 0.59f) + 0.14f);
+			} break;
+		InvalidDefaultCase;
+	}
+	return(Clamp01(Result));
+}
+
+internal void
+ResolvePixelsScalar(resolve_task* Task, u32 FirstPixel, u32 OnePastLastPixel)
+{
+	for(u32 PixelIndex = FirstPixel; PixelIndex < OnePastLastPixel; ++PixelIndex)
+	{
+		v3* Accumulated = Task->Backbuffer + PixelIndex;
+		if(Task->PassBuffer)
+		{
+			*Accumulated += Task->PassBuffer[PixelIndex];
+		}
+
+		if(Task->Pixels)
+		{
+			v3 Color = Task->InvSampleCount * (*Accumulated);
+			Color.r = TonemapChannel(Color.r, Task->Tonemap);
+			Color.g = TonemapChannel(Color.g, Task->Tonemap);
+			Color.b = TonemapChannel(Color.b, Task->Tonemap);
+			v3 SRGBColor = LinearToSRGB(Color);
+			if(Task->PreviousScreen)
+			{
+				Task->Variation += LengthSqr(SRGBColor - Task->PreviousScreen[PixelIndex]);
+				Task->PreviousScreen[PixelIndex] = SRGBColor;
+			}
+			Task->Pixels[PixelIndex] = RGBToPixel(SRGBColor);
+		}
+	}
+}
+
+#if RAY_SSE
+// NOTE(hugo): A = r0 g0 b0 r1, B = g1 b1 r2 g2, C = b2 r3 g3 b3
+// becomes R = r0 r1 r2 r3, G = g0 g1 g2 g3, B = b0 b1 b2 b3.
+inline void
+Deinterleave3(__m128 A, __m128 B, __m128 C, __m128* R, __m128* G, __m128* Bl)
+{
+	__m128 RHigh = _mm_shuffle_ps(B, C, _MM_SHUFFLE(0, 1, 0, 2));
+	*R = _mm_shuffle_ps(A, RHigh, _MM_SHUFFLE(2, 0, 3, 0));
+	__m128 GLow = _mm_shuffle_ps(A, B, _MM_SHUFFLE(3, 0, 1, 1));
+	__m128 GHigh = _mm_shuffle_ps(B, C, _MM_SHUFFLE(2, 2, 3, 3));
+	*G = _mm_shuffle_ps(GLow, GHigh, _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 BLow = _mm_shuffle_ps(A, B, _MM_SHUFFLE(1, 1, 2, 2));
+	__m128 BHigh = _mm_shuffle_ps(C, C, _MM_SHUFFLE(3, 3, 0, 0));
+	*Bl = _mm_shuffle_ps(BLow, BHigh, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// NOTE(hugo): Inverse of Deinterleave3.
+inline void
+Interleave3(__m128 R, __m128 G, __m128 Bl, __m128* A, __m128* B, __m128* C)
+{
+	*A = _mm_shuffle_ps(_mm_shuffle_ps(R, G, _MM_SHUFFLE(0, 0, 0, 0)),
+			_mm_shuffle_ps(Bl, R, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	*B = _mm_shuffle_ps(_mm_shuffle_ps(G, Bl, _MM_SHUFFLE(1, 1, 1, 1)),
+			_mm_shuffle_ps(R, G, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+	*C = _mm_shuffle_ps(_mm_shuffle_ps(Bl, R, _MM_SHUFFLE(3, 3, 2, 2)),
+			_mm_shuffle_ps(G, Bl, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+inline __m128
+TonemapChannel4(__m128 C, tonemap_operator Tonemap)
+{
+	__m128 One = _mm_set1_ps(1.0f);
+	__m128 Result = C;
+	switch(Tonemap)
+	{
+		case Tonemap_None:
+			{
+			} break;
+		case Tonemap_Reinhard:
+			{
+				Result = _mm_div_ps(C, _mm_add_ps(One, C));
+			} break;
+		case Tonemap_ACES:
+			{
+				__m128 Numerator = _mm_mul_ps(C, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), C), _mm_set1_ps(0.03f)));
+				__m128 Denominator = _mm_add_ps(_mm_mul_ps(C, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), C), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+				Result = _mm_div_ps(Numerator, Denominator);
+			} break;
+		InvalidDefaultCase;
+	}
+	Result = _mm_min_ps(_mm_max_ps(Result, _mm_setzero_ps()), One);
+	return(Result);
+}
+
+internal void
+ResolvePixelsSSE(resolve_task* Task, u32 FirstPixel, u32 OnePastLastPixel)
+{
+	Assert(((OnePastLastPixel - FirstPixel) % 4) == 0);
+
+	__m128 InvSampleCount = _mm_set1_ps(Task->InvSampleCount);
+	__m128 ColorScale = _mm_set1_ps(255.99f);
+	__m128i Alpha = _mm_set1_epi32(s32(0xFF000000));
+	__m128 Variation = _mm_setzero_ps();
+
+	for(u32 PixelIndex = FirstPixel; PixelIndex < OnePastLastPixel; PixelIndex += 4)
+	{
+		float* Accumulated = (float *)(Task->Backbuffer + PixelIndex);
+		__m128 A = _mm_loadu_ps(Accumulated + 0);
+		__m128 B = _mm_loadu_ps(Accumulated + 4);
+		__m128 C = _mm_loadu_ps(Accumulated + 8);
+		if(Task->PassBuffer)
+		{
+			float* Pass = (float *)(Task->PassBuffer + PixelIndex);
+			A = _mm_add_ps(A, _mm_loadu_ps(Pass + 0));
+			B = _mm_add_ps(B, _mm_loadu_ps(Pass + 4));
+			C = _mm_add_ps(C, _mm_loadu_ps(Pass + 8));
+			_mm_storeu_ps(Accumulated + 0, A);
+			_mm_storeu_ps(Accumulated + 4, B);
+			_mm_storeu_ps(Accumulated + 8, C);
+		}
+
+		if(Task->Pixels)
+		{
+			__m128 R, G, Bl;
+			Deinterleave3(A, B, C, &R, &G, &Bl);
+			R = _mm_sqrt_ps(TonemapChannel4(_mm_mul_ps(R, InvSampleCount), Task->Tonemap));
+			G = _mm_sqrt_ps(TonemapChannel4(_mm_mul_ps(G, InvSampleCount), Task->Tonemap));
+			Bl = _mm_sqrt_ps(TonemapChannel4(_mm_mul_ps(Bl, InvSampleCount), Task->Tonemap));
+
+			if(Task->PreviousScreen)
+			{
+				float* Previous = (float *)(Task->PreviousScreen + PixelIndex);
+				__m128 PR, PG, PB;
+				Deinterleave3(_mm_loadu_ps(Previous + 0), _mm_loadu_ps(Previous + 4), _mm_loadu_ps(Previous + 8), &PR, &PG, &PB);
+				__m128 DR = _mm_sub_ps(R, PR);
+				__m128 DG = _mm_sub_ps(G, PG);
+				__m128 DB = _mm_sub_ps(Bl, PB);
+				Variation = _mm_add_ps(Variation, _mm_add_ps(_mm_mul_ps(DR, DR), _mm_add_ps(_mm_mul_ps(DG, DG), _mm_mul_ps(DB, DB))));
+
+				__m128 SA, SB, SC;
+				Interleave3(R, G, Bl, &SA, &SB, &SC);
+				_mm_storeu_ps(Previous + 0, SA);
+				_mm_storeu_ps(Previous + 4, SB);
+				_mm_storeu_ps(Previous + 8, SC);
+			}
+
+			__m128i RI = _mm_cvttps_epi32(_mm_mul_ps(R, ColorScale));
+			__m128i GI = _mm_cvttps_epi32(_mm_mul_ps(G, ColorScale));
+			__m128i BI = _mm_cvttps_epi32(_mm_mul_ps(Bl, ColorScale));
+			__m128i Packed = _mm_or_si128(_mm_or_si128(Alpha, _mm_slli_epi32(RI, 16)),
+					_mm_or_si128(_mm_slli_epi32(GI, 8), BI));
+			_mm_storeu_si128((__m128i *)(Task->Pixels + PixelIndex), Packed);
+		}
+	}
+
+	float VariationLanes[4];
+	_mm_storeu_ps(VariationLanes, Variation);
+	Task->Variation += VariationLanes[0] + VariationLanes[1] + VariationLanes[2] + VariationLanes[3];
+}
+#endif
+
+internal void
+ResolvePixels(resolve_task* Task)
+{
+	u32 FirstPixel = Task->FirstPixel;
+	u32 OnePastLastPixel = Task->FirstPixel + Task->PixelCount;
+	Task->Variation = 0.0f;
+#if RAY_SSE
+	u32 OnePastLastWidePixel = FirstPixel + 4 * (Task->PixelCount / 4);
+	ResolvePixelsSSE(Task, FirstPixel, OnePastLastWidePixel);
+	FirstPixel = OnePastLastWidePixel;
+#endif
+	ResolvePixelsScalar(Task, FirstPixel, OnePastLastPixel);
+}
+
+PLATFORM_WORK_QUEUE_CALLBACK(ResolveTask)
+{
+	resolve_task* Task = (resolve_task *)Data;
+	TIMED_BLOCK_COUNTED(Resolve, Task->PixelCount);
+	TraceTask("resolve", Task->FirstPixel, 0);
+	ResolvePixels(Task);
+}
+
+// NOTE(hugo): Resolves the whole framebuffer on the work queue and
+// returns the variation with the previous image (0 if PreviousScreen
+// is null). Tasks are pushed after the tiles of the pass in flight,
+// so deque owners run them first.
+internal float
+ResolveFramebuffer(platform_work_queue* Queue, memory_arena* Arena,
+		v3* Backbuffer, v3* PassBuffer, u32* Pixels, v3* PreviousScreen,
+		u32 PixelCount, u32 SampleCount, tonemap_operator Tonemap)
+{
+	// NOTE(hugo): A few bands per thread, each a multiple of
+	// four pixels and not too small to be worth a task.
+	u32 TaskCount = 4 * Queue->DequeCount;
+	u32 PixelsPerTask = (PixelCount + TaskCount - 1) / TaskCount;
+	PixelsPerTask = 4 * ((PixelsPerTask + 3) / 4);
+	if(PixelsPerTask < 4096)
+	{
+		PixelsPerTask = 4096;
+	}
+	TaskCount = (PixelCount + PixelsPerTask - 1) / PixelsPerTask;
+
+	temporary_memory TempMemory = BeginTemporaryMemory(Arena);
+	resolve_task* Tasks = PushArray(Arena, TaskCount, resolve_task, Align(64, true));
+	platform_task_group Group = {};
+	for(u32 TaskIndex = 0; TaskIndex < TaskCount; ++TaskIndex)
+	{
+		resolve_task* Task = Tasks + TaskIndex;
+		Task->Backbuffer = Backbuffer;
+		Task->PassBuffer = PassBuffer;
+		Task->Pixels = Pixels;
+		Task->PreviousScreen = PreviousScreen;
+		Task->FirstPixel = TaskIndex * PixelsPerTask;
+		Task->PixelCount = Minu(PixelsPerTask, PixelCount - Task->FirstPixel);
+		Task->InvSampleCount = 1.0f / float(SampleCount);
+		Task->Tonemap = Tonemap;
+		SDLAddEntry(Queue, &Group, ResolveTask, Task);
+	}
+	SDLWaitForTaskGroup(Queue, &Group);
+
+	float Variation = 0.0f;
+	for(u32 TaskIndex = 0; TaskIndex < TaskCount; ++TaskIndex)
+	{
+		Variation += Tasks[TaskIndex].Variation;
+	}
+	EndTemporaryMemory(TempMemory);
+
+	return(Variation);
+}
+
+// NOTE(hugo): Time to resolve one megapixel : the former scalar loop,
+// the SIMD kernel on one thread, then the SIMD kernel on the queue.
+internal void
+RunResolveBenchmark(platform_work_queue* Queue, memory_arena* Arena,
+		u32 PixelCount, u32 Iterations, tonemap_operator Tonemap)
+{
+	temporary_memory TempMemory = BeginTemporaryMemory(Arena);
+	v3* Backbuffer = PushArray(Arena, PixelCount, v3, Align(64, false));
+	v3* PreviousScreen = PushArray(Arena, PixelCount, v3, Align(64, true));
+	u32* Pixels = PushArray(Arena, PixelCount, u32, Align(64, false));
+
+	random_series Series = RandomSeed(1234, 1235);
+	for(u32 PixelIndex = 0; PixelIndex < PixelCount; ++PixelIndex)
+	{
+		Backbuffer[PixelIndex] = V3(RandomBetween(&Series, 0.0f, 64.0f),
+				RandomBetween(&Series, 0.0f, 64.0f), RandomBetween(&Series, 0.0f, 64.0f));
+	}
+
+	double PerformanceFrequency = double(SDL_GetPerformanceFrequency());
+	double Megapixels = double(PixelCount) * double(Iterations) / 1000000.0;
+	char* Names[] = {"scalar, 1 thread", "SIMD, 1 thread", "SIMD, work queue"};
+	for(u32 ModeIndex = 0; ModeIndex < ArrayCount(Names); ++ModeIndex)
+	{
+		u64 Start = SDL_GetPerformanceCounter();
+		for(u32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			resolve_task Task = {};
+			Task.Backbuffer = Backbuffer;
+			Task.Pixels = Pixels;
+			Task.PreviousScreen = PreviousScreen;
+			Task.PixelCount = PixelCount;
+			Task.InvSampleCount = 1.0f / 64.0f;
+			Task.Tonemap = Tonemap;
+			switch(ModeIndex)
+			{
+				case 0:
+					{
+						ResolvePixelsScalar(&Task, 0, PixelCount);
+					} break;
+				case 1:
+					{
+						ResolvePixels(&Task);
+					} break;
+				case 2:
+					{
+						ResolveFramebuffer(Queue, Arena, Backbuffer, 0, Pixels, PreviousScreen,
+								PixelCount, 64, Tonemap);
+					} break;
+				InvalidDefaultCase;
+			}
+		}
+		double Seconds = double(SDL_GetPerformanceCounter() - Start) / PerformanceFrequency;
+		printf("\tResolve %-18s %.3f ms per megapixel\n", Names[ModeIndex], 1000.0 * Seconds / Megapixels);
+	}
+
+	EndTemporaryMemory(TempMemory);
+}
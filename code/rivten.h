@@ -84,12 +84,38 @@ void* ReAllocate_(void* Buffer, size_t Size)
 }
 // }
 
+enum arena_reserve_flag
+{
+	ArenaReserve_None = 0x0,
+	// NOTE(hugo): Ask for transparent huge pages (Linux), so that big
+	// arrays walked at random need fewer TLB entries.
+	ArenaReserve_HugePages = 0x1,
+};
+
+// NOTE(hugo): An arena is either over a buffer it was given, all of it
+// usable, or over a range of address space it reserved itself
+// (InitialiseVirtualArena), made usable bit by bit as pushes need it.
+// Committed memory is never given back, so it is also the peak.
+//
+// Every push is added to the size of the current tag of the arena
+// (SetArenaTag, 0 by default), the caller deciding what a tag means.
+// Pushes inside a temporary memory are not : they do not stay.
+#define ARENA_TAG_COUNT 16
+#define ARENA_NEARLY_FULL_PERCENT 90
 struct memory_arena
 {
 	memory_index Size;
 	memory_index Used;
 	u8* Base;
 
+	memory_index Committed;
+	// NOTE(hugo): arena_reserve_flag, the ones of the reserve.
+	u32 Flags;
+
+	u32 Tag;
+	memory_index TaggedSize[ARENA_TAG_COUNT];
+	b32 WarnedNearlyFull;
+
 	u32 TemporaryCount;
 };
 
@@ -105,6 +131,172 @@ void InitialiseArena(memory_arena* Arena, memory_index Size, void* Base)
 	Arena->Used = 0;
 	Arena->TemporaryCount = 0;
 	Arena->Base = (u8 *)Base;
+	Arena->Committed = Size;
+	Arena->Flags = 0;
+	Arena->Tag = 0;
+	for(u32 TagIndex = 0; TagIndex < ARENA_TAG_COUNT; ++TagIndex)
+	{
+		Arena->TaggedSize[TagIndex] = 0;
+	}
+	Arena->WarnedNearlyFull = false;
+}
+
+// NOTE(hugo): Forgets every push. The memory stays committed.
+void ClearArena(memory_arena* Arena)
+{
+	Assert(Arena->TemporaryCount == 0);
+	Arena->Used = 0;
+	for(u32 TagIndex = 0; TagIndex < ARENA_TAG_COUNT; ++TagIndex)
+	{
+		Arena->TaggedSize[TagIndex] = 0;
+	}
+}
+
+// NOTE(hugo): Returns the previous tag, to set it back.
+inline u32
+SetArenaTag(memory_arena* Arena, u32 Tag)
+{
+	Assert(Tag < ARENA_TAG_COUNT);
+	u32 Result = Arena->Tag;
+	Arena->Tag = Tag;
+	return(Result);
+}
+
+// NOTE(hugo): Only the virtual memory of the arenas needs the system
+// headers, without the min and max macros of windows.h.
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// NOTE(hugo): Only for an arena over a buffer : the reserve of a
+// virtual arena is address space, far bigger than any machine, the
+// memory budget below is what it runs into.
+inline b32
+IsArenaNearlyFull(memory_arena* Arena)
+{
+	b32 Result = (Arena->Used > (Arena->Size / 100) * ARENA_NEARLY_FULL_PERCENT);
+	return(Result);
+}
+
+// NOTE(hugo): Memory every virtual arena may commit together, the
+// physical memory of the machine unless set otherwise (0 : no budget).
+// The commits are summed from every thread.
+global_variable memory_index GlobalArenaMemoryBudget;
+global_variable memory_index volatile GlobalArenaCommitted;
+global_variable b32 GlobalWarnedOverBudget;
+
+inline memory_index
+GetPhysicalMemorySize(void)
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX Status = {};
+	Status.dwLength = sizeof(Status);
+	GlobalMemoryStatusEx(&Status);
+	memory_index Result = memory_index(Status.ullTotalPhys);
+#else
+	memory_index Result = memory_index(sysconf(_SC_PHYS_PAGES)) * memory_index(sysconf(_SC_PAGESIZE));
+#endif
+	return(Result);
+}
+
+inline void
+SetArenaMemoryBudget(memory_index Budget)
+{
+	GlobalArenaMemoryBudget = Budget;
+}
+
+inline b32
+IsArenaMemoryNearlyFull(void)
+{
+	b32 Result = (GlobalArenaMemoryBudget > 0) &&
+		(GlobalArenaCommitted > (GlobalArenaMemoryBudget / 100) * ARENA_NEARLY_FULL_PERCENT);
+	return(Result);
+}
+
+#define ARENA_COMMIT_GRANULARITY Kilobytes(64)
+#define ARENA_HUGE_PAGE_SIZE Megabytes(2)
+
+inline memory_index
+GetArenaCommitGranularity(memory_arena* Arena)
+{
+	memory_index Result = (Arena->Flags & ArenaReserve_HugePages) ? ARENA_HUGE_PAGE_SIZE : ARENA_COMMIT_GRANULARITY;
+	return(Result);
+}
+
+// NOTE(hugo): Only reserves address space : nothing is backed by memory
+// (nor counted against the commit limit) before a push needs it, so
+// the reserve can be far bigger than any scene.
+void InitialiseVirtualArena(memory_arena* Arena, memory_index ReserveSize, arena_reserve_flag Flags = ArenaReserve_None)
+{
+	memory_index Alignment = (Flags & ArenaReserve_HugePages) ? ARENA_HUGE_PAGE_SIZE : ARENA_COMMIT_GRANULARITY;
+	ReserveSize = (ReserveSize + Alignment - 1) & ~(Alignment - 1);
+#ifdef _WIN32
+	// NOTE(hugo): Large pages on Windows need a privilege and cannot
+	// be committed lazily, so the flag is ignored there.
+	void* Base = VirtualAlloc(0, ReserveSize, MEM_RESERVE, PAGE_NOACCESS);
+	Assert(Base);
+#else
+	// NOTE(hugo): Reserve one more huge page to align the base on one.
+	u8* Reserved = (u8 *)mmap(0, ReserveSize + Alignment, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	Assert(Reserved != MAP_FAILED);
+	void* Base = (void *)(((memory_index)Reserved + Alignment - 1) & ~(Alignment - 1));
+#endif
+
+	InitialiseArena(Arena, ReserveSize, Base);
+	Arena->Committed = 0;
+	Arena->Flags = Flags;
+}
+
+void CommitArenaMemory(memory_arena* Arena, memory_index MinCommitted)
+{
+	memory_index Granularity = GetArenaCommitGranularity(Arena);
+	memory_index NewCommitted = (MinCommitted + Granularity - 1) & ~(Granularity - 1);
+	if(NewCommitted > Arena->Size)
+	{
+		NewCommitted = Arena->Size;
+	}
+	Assert(NewCommitted > Arena->Committed);
+
+	u8* CommitBase = Arena->Base + Arena->Committed;
+	memory_index CommitSize = NewCommitted - Arena->Committed;
+#ifdef _WIN32
+	void* Result = VirtualAlloc(CommitBase, CommitSize, MEM_COMMIT, PAGE_READWRITE);
+	Assert(Result);
+#else
+	int Result = mprotect(CommitBase, CommitSize, PROT_READ | PROT_WRITE);
+	Assert(Result == 0);
+#ifdef MADV_HUGEPAGE
+	if(Arena->Flags & ArenaReserve_HugePages)
+	{
+		// NOTE(hugo): Only a hint, THP might be disabled on the machine.
+		madvise(CommitBase, CommitSize, MADV_HUGEPAGE);
+	}
+#endif
+#endif
+
+	Arena->Committed = NewCommitted;
+#ifdef _WIN32
+	InterlockedExchangeAdd64((LONG64 volatile *)&GlobalArenaCommitted, LONG64(CommitSize));
+#else
+	__sync_fetch_and_add(&GlobalArenaCommitted, CommitSize);
+#endif
+	if(!GlobalWarnedOverBudget && IsArenaMemoryNearlyFull())
+	{
+		printf("Warning : the arenas committed %.1fMB, over %d%% of the %.1fMB memory budget.\n",
+				double(GlobalArenaCommitted) / double(Megabytes(1)), ARENA_NEARLY_FULL_PERCENT,
+				double(GlobalArenaMemoryBudget) / double(Megabytes(1)));
+		GlobalWarnedOverBudget = true;
+	}
 }
 
 inline memory_index
@@ -192,10 +384,24 @@ void* PushSize_(memory_arena* Arena, memory_index SizeInit, arena_push_params Pa
 {
 	memory_index Size = GetEffectiveSizeFor(Arena, SizeInit, Params);
 	Assert(Arena->Used + Size <= Arena->Size);
+	if(Arena->Used + Size > Arena->Committed)
+	{
+		CommitArenaMemory(Arena, Arena->Used + Size);
+	}
 
 	memory_index AlignmentOffset = GetAlignmentOffset(Arena, Params.Alignment);
 	void* Result = Arena->Base + Arena->Used + AlignmentOffset;
 	Arena->Used += Size;
+	if(Arena->TemporaryCount == 0)
+	{
+		Arena->TaggedSize[Arena->Tag] += Size;
+	}
+	if(!Arena->WarnedNearlyFull && IsArenaNearlyFull(Arena))
+	{
+		printf("Warning : an arena is over %d%% full (%.1fMB of %.1fMB).\n", ARENA_NEARLY_FULL_PERCENT,
+				double(Arena->Used) / double(Megabytes(1)), double(Arena->Size) / double(Megabytes(1)));
+		Arena->WarnedNearlyFull = true;
+	}
 
     if(Params.Flags & ArenaFlag_ClearToZero)
     {
@@ -205,6 +411,13 @@ void* PushSize_(memory_arena* Arena, memory_index SizeInit, arena_push_params Pa
 	return(Result);
 }
 
+void PrintArenaUsage(char* Name, memory_arena* Arena)
+{
+	printf("Arena %-14s %9.1fMB used, %9.1fMB committed at peak, of %.0fMB%s\n", Name,
+			double(Arena->Used) / double(Megabytes(1)), double(Arena->Committed) / double(Megabytes(1)),
+			double(Arena->Size) / double(Megabytes(1)), IsArenaNearlyFull(Arena) ? " (nearly full !)" : "");
+}
+
 temporary_memory BeginTemporaryMemory(memory_arena* Arena)
 {
 	temporary_memory Result = {};
@@ -6,6 +6,13 @@
 #define MAX_REAL FLT_MAX
 #define MIN_REAL -FLT_MAX
 
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#define RIVTEN_MATH_SSE 1
+#include <xmmintrin.h>
+#else
+#define RIVTEN_MATH_SSE 0
+#endif
+
 float Square(float X)
 {
     float Result = X * X;
@@ -45,6 +52,45 @@ float SquareRoot(float X)
     return(Result);
 }
 
+/* NOTE(hugo)
+ *    1 / sqrt(X) in three precisions :
+ *    - InverseSquareRoot : the sqrt and the divide, exact.
+ *    - InverseSquareRootFast : the hardware estimate refined by one
+ *      Newton step, a few ulps off. Good for ray directions and
+ *      normals.
+ *    - InverseSquareRootApprox : the hardware estimate alone, about
+ *      12 bits. Only for what is compared or thresholded afterwards.
+ *    Without SSE all three are the exact one.
+ */
+float InverseSquareRoot(float X)
+{
+	float Result = 1.0f / sqrt(X);
+	return(Result);
+}
+
+float InverseSquareRootApprox(float X)
+{
+#if RIVTEN_MATH_SSE
+	float Result = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(X)));
+#else
+	float Result = 1.0f / sqrt(X);
+#endif
+	return(Result);
+}
+
+float InverseSquareRootFast(float X)
+{
+#if RIVTEN_MATH_SSE
+	// NOTE(hugo): Newton on f(y) = 1 / y^2 - X,
+	// which doubles the number of correct bits.
+	float Estimate = InverseSquareRootApprox(X);
+	float Result = Estimate * (1.5f - 0.5f * X * Estimate * Estimate);
+#else
+	float Result = 1.0f / sqrt(X);
+#endif
+	return(Result);
+}
+
 int Floor(float X)
 {
     int Result;
@@ -137,7 +183,7 @@ float Minf(float A, float B)
 	}
 }
 
-float Maxu(u32 A, u32 B)
+u32 Maxu(u32 A, u32 B)
 {
 	if(A >= B)
 	{
@@ -149,7 +195,7 @@ float Maxu(u32 A, u32 B)
 	}
 }
 
-float Minu(u32 A, u32 B)
+u32 Minu(u32 A, u32 B)
 {
 	if(A <= B)
 	{
@@ -589,6 +635,18 @@ v3 Normalized(v3 A)
     return(Result);
 }
 
+v3 NormalizedFast(v3 A)
+{
+	v3 Result = InverseSquareRootFast(LengthSqr(A)) * A;
+	return(Result);
+}
+
+v3 NormalizedApprox(v3 A)
+{
+	v3 Result = InverseSquareRootApprox(LengthSqr(A)) * A;
+	return(Result);
+}
+
 v3 Cross(v3 A, v3 B)
 {
 	v3 Result;
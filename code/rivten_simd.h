@@ -0,0 +1,433 @@
+#pragma once
+
+/* NOTE(hugo)
+ *    Wide versions of the float and v3 of rivten_math.h, one value
+ *    per SIMD lane : f32x4 / v3x4 on SSE2, f32x8 / v3x8 on AVX, and
+ *    the lane masks their comparisons return. A v3x4 is stored as
+ *    three registers (all the x, all the y, all the z), so that a Dot
+ *    or a Cross over 4 rays costs as many instructions as over one.
+ *
+ *    The functions keep the names of their scalar versions. Select
+ *    follows the packet code : Select(Mask, A, B) is B in the lanes
+ *    where the mask is set, A in the others.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define RIVTEN_SIMD_SSE 1
+#include <emmintrin.h>
+#else
+#define RIVTEN_SIMD_SSE 0
+#endif
+
+#if defined(__AVX__)
+#define RIVTEN_SIMD_AVX 1
+#include <immintrin.h>
+#else
+#define RIVTEN_SIMD_AVX 0
+#endif
+
+#if RIVTEN_SIMD_SSE
+
+/* ------------------------------
+ *        f32x4 / mask4
+ * ------------------------------ */
+
+struct f32x4
+{
+	__m128 V;
+};
+
+struct mask4
+{
+	__m128 V;
+};
+
+inline f32x4 F32x4(float A)
+{
+	f32x4 Result = {_mm_set1_ps(A)};
+	return(Result);
+}
+
+inline f32x4 F32x4(float A, float B, float C, float D)
+{
+	f32x4 Result = {_mm_setr_ps(A, B, C, D)};
+	return(Result);
+}
+
+inline f32x4 F32x4(__m128 V)
+{
+	f32x4 Result = {V};
+	return(Result);
+}
+
+// NOTE(hugo): Unaligned load and store of 4 consecutive floats.
+inline f32x4 LoadF32x4(float* Source)
+{
+	f32x4 Result = {_mm_loadu_ps(Source)};
+	return(Result);
+}
+
+inline void StoreF32x4(float* Dest, f32x4 A)
+{
+	_mm_storeu_ps(Dest, A.V);
+}
+
+inline float GetLane(f32x4 A, u32 Lane)
+{
+	Assert(Lane < 4);
+	float Lanes[4];
+	_mm_storeu_ps(Lanes, A.V);
+	return(Lanes[Lane]);
+}
+
+inline f32x4 operator+(f32x4 A, f32x4 B) {return(F32x4(_mm_add_ps(A.V, B.V)));}
+inline f32x4 operator-(f32x4 A, f32x4 B) {return(F32x4(_mm_sub_ps(A.V, B.V)));}
+inline f32x4 operator*(f32x4 A, f32x4 B) {return(F32x4(_mm_mul_ps(A.V, B.V)));}
+inline f32x4 operator/(f32x4 A, f32x4 B) {return(F32x4(_mm_div_ps(A.V, B.V)));}
+inline f32x4 operator-(f32x4 A) {return(F32x4(_mm_sub_ps(_mm_setzero_ps(), A.V)));}
+inline void operator+=(f32x4& A, f32x4 B) {A = A + B;}
+inline void operator-=(f32x4& A, f32x4 B) {A = A - B;}
+inline void operator*=(f32x4& A, f32x4 B) {A = A * B;}
+
+inline mask4 operator<(f32x4 A, f32x4 B) {mask4 Result = {_mm_cmplt_ps(A.V, B.V)}; return(Result);}
+inline mask4 operator<=(f32x4 A, f32x4 B) {mask4 Result = {_mm_cmple_ps(A.V, B.V)}; return(Result);}
+inline mask4 operator>(f32x4 A, f32x4 B) {mask4 Result = {_mm_cmpgt_ps(A.V, B.V)}; return(Result);}
+inline mask4 operator>=(f32x4 A, f32x4 B) {mask4 Result = {_mm_cmpge_ps(A.V, B.V)}; return(Result);}
+inline mask4 operator==(f32x4 A, f32x4 B) {mask4 Result = {_mm_cmpeq_ps(A.V, B.V)}; return(Result);}
+inline mask4 operator!=(f32x4 A, f32x4 B) {mask4 Result = {_mm_cmpneq_ps(A.V, B.V)}; return(Result);}
+
+inline mask4 operator&(mask4 A, mask4 B) {mask4 Result = {_mm_and_ps(A.V, B.V)}; return(Result);}
+inline mask4 operator|(mask4 A, mask4 B) {mask4 Result = {_mm_or_ps(A.V, B.V)}; return(Result);}
+inline mask4 operator^(mask4 A, mask4 B) {mask4 Result = {_mm_xor_ps(A.V, B.V)}; return(Result);}
+// NOTE(hugo): A and not B.
+inline mask4 AndNot(mask4 A, mask4 B) {mask4 Result = {_mm_andnot_ps(B.V, A.V)}; return(Result);}
+
+// NOTE(hugo): Bit i is set when lane i is.
+inline u32 MaskBits(mask4 A)
+{
+	return(u32(_mm_movemask_ps(A.V)));
+}
+
+inline bool AnyLane(mask4 A)
+{
+	return(MaskBits(A) != 0);
+}
+
+inline bool AllLanes(mask4 A)
+{
+	return(MaskBits(A) == 0xF);
+}
+
+inline f32x4 Select(mask4 Mask, f32x4 A, f32x4 B)
+{
+	f32x4 Result = {_mm_or_ps(_mm_and_ps(Mask.V, B.V), _mm_andnot_ps(Mask.V, A.V))};
+	return(Result);
+}
+
+inline f32x4 Minf(f32x4 A, f32x4 B) {return(F32x4(_mm_min_ps(A.V, B.V)));}
+inline f32x4 Maxf(f32x4 A, f32x4 B) {return(F32x4(_mm_max_ps(A.V, B.V)));}
+inline f32x4 SquareRoot(f32x4 A) {return(F32x4(_mm_sqrt_ps(A.V)));}
+
+// NOTE(hugo): Same precisions as the scalar InverseSquareRoot*.
+inline f32x4 InverseSquareRoot(f32x4 A) {return(F32x4(1.0f) / SquareRoot(A));}
+inline f32x4 InverseSquareRootApprox(f32x4 A) {return(F32x4(_mm_rsqrt_ps(A.V)));}
+
+inline f32x4 InverseSquareRootFast(f32x4 A)
+{
+	f32x4 Estimate = InverseSquareRootApprox(A);
+	return(Estimate * (F32x4(1.5f) - F32x4(0.5f) * A * Estimate * Estimate));
+}
+
+inline f32x4 Abs(f32x4 A)
+{
+	f32x4 Result = {_mm_andnot_ps(_mm_set1_ps(-0.0f), A.V)};
+	return(Result);
+}
+
+inline f32x4 Clamp01(f32x4 A)
+{
+	return(Minf(Maxf(A, F32x4(0.0f)), F32x4(1.0f)));
+}
+
+/* ------------------------------
+ *           v3x4
+ * ------------------------------ */
+
+struct v3x4
+{
+	f32x4 x;
+	f32x4 y;
+	f32x4 z;
+};
+
+inline v3x4 V3x4(f32x4 x, f32x4 y, f32x4 z)
+{
+	v3x4 Result = {x, y, z};
+	return(Result);
+}
+
+// NOTE(hugo): The same v3 in every lane.
+inline v3x4 V3x4(v3 A)
+{
+	return(V3x4(F32x4(A.x), F32x4(A.y), F32x4(A.z)));
+}
+
+// NOTE(hugo): One v3 per lane.
+inline v3x4 V3x4(v3 A, v3 B, v3 C, v3 D)
+{
+	return(V3x4(F32x4(A.x, B.x, C.x, D.x), F32x4(A.y, B.y, C.y, D.y), F32x4(A.z, B.z, C.z, D.z)));
+}
+
+inline v3 GetLane(v3x4 A, u32 Lane)
+{
+	return(V3(GetLane(A.x, Lane), GetLane(A.y, Lane), GetLane(A.z, Lane)));
+}
+
+inline v3x4 operator+(v3x4 A, v3x4 B) {return(V3x4(A.x + B.x, A.y + B.y, A.z + B.z));}
+inline v3x4 operator-(v3x4 A, v3x4 B) {return(V3x4(A.x - B.x, A.y - B.y, A.z - B.z));}
+inline v3x4 operator*(f32x4 Lambda, v3x4 A) {return(V3x4(Lambda * A.x, Lambda * A.y, Lambda * A.z));}
+inline v3x4 operator-(v3x4 A) {return(V3x4(-A.x, -A.y, -A.z));}
+inline void operator+=(v3x4& A, v3x4 B) {A = A + B;}
+inline void operator-=(v3x4& A, v3x4 B) {A = A - B;}
+
+inline f32x4 Dot(v3x4 A, v3x4 B)
+{
+	return(A.x * B.x + A.y * B.y + A.z * B.z);
+}
+
+inline f32x4 LengthSqr(v3x4 A)
+{
+	return(Dot(A, A));
+}
+
+inline v3x4 Cross(v3x4 A, v3x4 B)
+{
+	return(V3x4(A.y * B.z - A.z * B.y,
+				A.z * B.x - A.x * B.z,
+				A.x * B.y - A.y * B.x));
+}
+
+inline v3x4 Hadamard(v3x4 A, v3x4 B)
+{
+	return(V3x4(A.x * B.x, A.y * B.y, A.z * B.z));
+}
+
+inline v3x4 Normalized(v3x4 A)
+{
+	f32x4 InvLength = F32x4(1.0f) / SquareRoot(LengthSqr(A));
+	return(InvLength * A);
+}
+
+inline v3x4 NormalizedFast(v3x4 A)
+{
+	return(InverseSquareRootFast(LengthSqr(A)) * A);
+}
+
+inline v3x4 NormalizedApprox(v3x4 A)
+{
+	return(InverseSquareRootApprox(LengthSqr(A)) * A);
+}
+
+inline v3x4 Minf(v3x4 A, v3x4 B) {return(V3x4(Minf(A.x, B.x), Minf(A.y, B.y), Minf(A.z, B.z)));}
+inline v3x4 Maxf(v3x4 A, v3x4 B) {return(V3x4(Maxf(A.x, B.x), Maxf(A.y, B.y), Maxf(A.z, B.z)));}
+
+inline v3x4 Select(mask4 Mask, v3x4 A, v3x4 B)
+{
+	return(V3x4(Select(Mask, A.x, B.x), Select(Mask, A.y, B.y), Select(Mask, A.z, B.z)));
+}
+
+#endif
+
+#if RIVTEN_SIMD_AVX
+
+/* ------------------------------
+ *        f32x8 / mask8
+ * ------------------------------ */
+
+struct f32x8
+{
+	__m256 V;
+};
+
+struct mask8
+{
+	__m256 V;
+};
+
+inline f32x8 F32x8(float A)
+{
+	f32x8 Result = {_mm256_set1_ps(A)};
+	return(Result);
+}
+
+inline f32x8 F32x8(__m256 V)
+{
+	f32x8 Result = {V};
+	return(Result);
+}
+
+inline f32x8 LoadF32x8(float* Source)
+{
+	f32x8 Result = {_mm256_loadu_ps(Source)};
+	return(Result);
+}
+
+inline void StoreF32x8(float* Dest, f32x8 A)
+{
+	_mm256_storeu_ps(Dest, A.V);
+}
+
+inline float GetLane(f32x8 A, u32 Lane)
+{
+	Assert(Lane < 8);
+	float Lanes[8];
+	_mm256_storeu_ps(Lanes, A.V);
+	return(Lanes[Lane]);
+}
+
+inline f32x8 operator+(f32x8 A, f32x8 B) {return(F32x8(_mm256_add_ps(A.V, B.V)));}
+inline f32x8 operator-(f32x8 A, f32x8 B) {return(F32x8(_mm256_sub_ps(A.V, B.V)));}
+inline f32x8 operator*(f32x8 A, f32x8 B) {return(F32x8(_mm256_mul_ps(A.V, B.V)));}
+inline f32x8 operator/(f32x8 A, f32x8 B) {return(F32x8(_mm256_div_ps(A.V, B.V)));}
+inline f32x8 operator-(f32x8 A) {return(F32x8(_mm256_sub_ps(_mm256_setzero_ps(), A.V)));}
+inline void operator+=(f32x8& A, f32x8 B) {A = A + B;}
+inline void operator-=(f32x8& A, f32x8 B) {A = A - B;}
+inline void operator*=(f32x8& A, f32x8 B) {A = A * B;}
+
+inline mask8 operator<(f32x8 A, f32x8 B) {mask8 Result = {_mm256_cmp_ps(A.V, B.V, _CMP_LT_OQ)}; return(Result);}
+inline mask8 operator<=(f32x8 A, f32x8 B) {mask8 Result = {_mm256_cmp_ps(A.V, B.V, _CMP_LE_OQ)}; return(Result);}
+inline mask8 operator>(f32x8 A, f32x8 B) {mask8 Result = {_mm256_cmp_ps(A.V, B.V, _CMP_GT_OQ)}; return(Result);}
+inline mask8 operator>=(f32x8 A, f32x8 B) {mask8 Result = {_mm256_cmp_ps(A.V, B.V, _CMP_GE_OQ)}; return(Result);}
+inline mask8 operator==(f32x8 A, f32x8 B) {mask8 Result = {_mm256_cmp_ps(A.V, B.V, _CMP_EQ_OQ)}; return(Result);}
+inline mask8 operator!=(f32x8 A, f32x8 B) {mask8 Result = {_mm256_cmp_ps(A.V, B.V, _CMP_NEQ_UQ)}; return(Result);}
+
+inline mask8 operator&(mask8 A, mask8 B) {mask8 Result = {_mm256_and_ps(A.V, B.V)}; return(Result);}
+inline mask8 operator|(mask8 A, mask8 B) {mask8 Result = {_mm256_or_ps(A.V, B.V)}; return(Result);}
+inline mask8 operator^(mask8 A, mask8 B) {mask8 Result = {_mm256_xor_ps(A.V, B.V)}; return(Result);}
+inline mask8 AndNot(mask8 A, mask8 B) {mask8 Result = {_mm256_andnot_ps(B.V, A.V)}; return(Result);}
+
+inline u32 MaskBits(mask8 A)
+{
+	return(u32(_mm256_movemask_ps(A.V)));
+}
+
+inline bool AnyLane(mask8 A)
+{
+	return(MaskBits(A) != 0);
+}
+
+inline bool AllLanes(mask8 A)
+{
+	return(MaskBits(A) == 0xFF);
+}
+
+inline f32x8 Select(mask8 Mask, f32x8 A, f32x8 B)
+{
+	f32x8 Result = {_mm256_blendv_ps(A.V, B.V, Mask.V)};
+	return(Result);
+}
+
+inline f32x8 Minf(f32x8 A, f32x8 B) {return(F32x8(_mm256_min_ps(A.V, B.V)));}
+inline f32x8 Maxf(f32x8 A, f32x8 B) {return(F32x8(_mm256_max_ps(A.V, B.V)));}
+inline f32x8 SquareRoot(f32x8 A) {return(F32x8(_mm256_sqrt_ps(A.V)));}
+inline f32x8 InverseSquareRoot(f32x8 A) {return(F32x8(1.0f) / SquareRoot(A));}
+inline f32x8 InverseSquareRootApprox(f32x8 A) {return(F32x8(_mm256_rsqrt_ps(A.V)));}
+
+inline f32x8 InverseSquareRootFast(f32x8 A)
+{
+	f32x8 Estimate = InverseSquareRootApprox(A);
+	return(Estimate * (F32x8(1.5f) - F32x8(0.5f) * A * Estimate * Estimate));
+}
+
+inline f32x8 Abs(f32x8 A)
+{
+	f32x8 Result = {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), A.V)};
+	return(Result);
+}
+
+inline f32x8 Clamp01(f32x8 A)
+{
+	return(Minf(Maxf(A, F32x8(0.0f)), F32x8(1.0f)));
+}
+
+/* ------------------------------
+ *           v3x8
+ * ------------------------------ */
+
+struct v3x8
+{
+	f32x8 x;
+	f32x8 y;
+	f32x8 z;
+};
+
+inline v3x8 V3x8(f32x8 x, f32x8 y, f32x8 z)
+{
+	v3x8 Result = {x, y, z};
+	return(Result);
+}
+
+inline v3x8 V3x8(v3 A)
+{
+	return(V3x8(F32x8(A.x), F32x8(A.y), F32x8(A.z)));
+}
+
+inline v3 GetLane(v3x8 A, u32 Lane)
+{
+	return(V3(GetLane(A.x, Lane), GetLane(A.y, Lane), GetLane(A.z, Lane)));
+}
+
+inline v3x8 operator+(v3x8 A, v3x8 B) {return(V3x8(A.x + B.x, A.y + B.y, A.z + B.z));}
+inline v3x8 operator-(v3x8 A, v3x8 B) {return(V3x8(A.x - B.x, A.y - B.y, A.z - B.z));}
+inline v3x8 operator*(f32x8 Lambda, v3x8 A) {return(V3x8(Lambda * A.x, Lambda * A.y, Lambda * A.z));}
+inline v3x8 operator-(v3x8 A) {return(V3x8(-A.x, -A.y, -A.z));}
+inline void operator+=(v3x8& A, v3x8 B) {A = A + B;}
+inline void operator-=(v3x8& A, v3x8 B) {A = A - B;}
+
+inline f32x8 Dot(v3x8 A, v3x8 B)
+{
+	return(A.x * B.x + A.y * B.y + A.z * B.z);
+}
+
+inline f32x8 LengthSqr(v3x8 A)
+{
+	return(Dot(A, A));
+}
+
+inline v3x8 Cross(v3x8 A, v3x8 B)
+{
+	return(V3x8(A.y * B.z - A.z * B.y,
+				A.z * B.x - A.x * B.z,
+				A.x * B.y - A.y * B.x));
+}
+
+inline v3x8 Hadamard(v3x8 A, v3x8 B)
+{
+	return(V3x8(A.x * B.x, A.y * B.y, A.z * B.z));
+}
+
+inline v3x8 Normalized(v3x8 A)
+{
+	f32x8 InvLength = F32x8(1.0f) / SquareRoot(LengthSqr(A));
+	return(InvLength * A);
+}
+
+inline v3x8 NormalizedFast(v3x8 A)
+{
+	return(InverseSquareRootFast(LengthSqr(A)) * A);
+}
+
+inline v3x8 NormalizedApprox(v3x8 A)
+{
+	return(InverseSquareRootApprox(LengthSqr(A)) * A);
+}
+
+inline v3x8 Minf(v3x8 A, v3x8 B) {return(V3x8(Minf(A.x, B.x), Minf(A.y, B.y), Minf(A.z, B.z)));}
+inline v3x8 Maxf(v3x8 A, v3x8 B) {return(V3x8(Maxf(A.x, B.x), Maxf(A.y, B.y), Maxf(A.z, B.z)));}
+
+inline v3x8 Select(mask8 Mask, v3x8 A, v3x8 B)
+{
+	return(V3x8(Select(Mask, A.x, B.x), Select(Mask, A.y, B.y), Select(Mask, A.z, B.z)));
+}
+
+#endif
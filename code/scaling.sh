@@ -0,0 +1,39 @@
+#!/bin/bash
+# NOTE(hugo): Thread scaling benchmark. Renders the same headless
+# frame with 1, 2, 4... up to N worker threads (N defaults to the
+# number of logical CPUs) and prints the speedup over one worker.
+# Any extra argument is forwarded to every run,
+# e.g. ./scaling.sh 64 --pinning spread --passes 8
+
+CODE_PATH="$(dirname "$0")"
+BUILD_PATH="$CODE_PATH/../build"
+MAX_THREADS=${1:-$(getconf _NPROCESSORS_ONLN)}
+shift
+
+ThreadCounts=""
+for (( Count = 1; Count < MAX_THREADS; Count *= 2 ))
+do
+	ThreadCounts+=" $Count"
+done
+ThreadCounts+=" $MAX_THREADS"
+
+pushd "$BUILD_PATH" > /dev/null
+for Count in $ThreadCounts
+do
+	./ray-x86_64 --headless --threads $Count --output scaling_render "$@" | grep "^Summary:"
+done | awk '
+{
+	for(i = 1; i <= NF; ++i)
+	{
+		split($i, KeyValue, "=");
+		Value[KeyValue[1]] = KeyValue[2];
+	}
+	if(NR == 1)
+	{
+		Base = Value["Mrays/s"];
+		printf("%8s %10s %8s %10s\n", "threads", "Mrays/s", "speedup", "efficiency");
+	}
+	Speedup = (Base > 0) ? Value["Mrays/s"] / Base : 0;
+	printf("%8d %10.3f %8.2f %9.0f%%\n", Value["threads"], Value["Mrays/s"], Speedup, 100 * Speedup / Value["threads"]);
+}'
+popd > /dev/null
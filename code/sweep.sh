@@ -0,0 +1,24 @@
+#!/bin/bash
+# NOTE(hugo): Headless performance sweep over scenes and tile sizes.
+# Each run prints a "Summary:" line, all of them are gathered in
+# build/sweep.txt. Any extra argument is forwarded to every run,
+# e.g. ./sweep.sh --passes 16 --width 1024 --height 1024
+
+CODE_PATH="$(dirname "$0")"
+BUILD_PATH="$CODE_PATH/../build"
+OUTPUT_FILE="$BUILD_PATH/sweep.txt"
+
+pushd "$BUILD_PATH" > /dev/null
+: > sweep.txt
+
+for Scene in ../data/CornellBox/CornellBox-Original-WithNormals.obj ../data/teapot_with_normal.obj
+do
+	for TileSize in 16 32 64
+	do
+		./ray-x86_64 --headless --scene "$Scene" --tile-width $TileSize --tile-height $TileSize \
+			--output sweep_render "$@" | grep "^Summary:" | tee -a sweep.txt
+	done
+done
+
+popd > /dev/null
+echo "Results written to $OUTPUT_FILE"
@@ -0,0 +1,144 @@
+#pragma once
+
+// NOTE(hugo): Order in which the tiles of a pass are handed out.
+// Following a space-filling curve keeps the tiles rendered at the same
+// time close on screen, so the threads traverse the same part of the
+// scene and share it in the caches. Centre-out shows the middle of the
+// image first, which is what matters for an interactive preview.
+enum tile_order
+{
+	TileOrder_Default,
+	TileOrder_Row,
+	TileOrder_Morton,
+	TileOrder_Hilbert,
+	TileOrder_CentreOut,
+};
+
+struct tile_sort_entry
+{
+	u32 XChunk;
+	u32 YChunk;
+	u64 Key;
+};
+
+inline u64
+SpreadBits(u32 Value)
+{
+	u64 Result = Value;
+	Result = (Result | (Result << 16)) & 0x0000FFFF0000FFFFULL;
+	Result = (Result | (Result << 8)) & 0x00FF00FF00FF00FFULL;
+	Result = (Result | (Result << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	Result = (Result | (Result << 2)) & 0x3333333333333333ULL;
+	Result = (Result | (Result << 1)) & 0x5555555555555555ULL;
+	return(Result);
+}
+
+inline u64
+MortonIndex(u32 X, u32 Y)
+{
+	u64 Result = SpreadBits(X) | (SpreadBits(Y) << 1);
+	return(Result);
+}
+
+// NOTE(hugo): Same thing in 3D, for up to 21 bits per coordinate.
+inline u64
+SpreadBits3(u32 Value)
+{
+	u64 Result = Value & 0x1FFFFF;
+	Result = (Result | (Result << 32)) & 0x001F00000000FFFFULL;
+	Result = (Result | (Result << 16)) & 0x001F0000FF0000FFULL;
+	Result = (Result | (Result << 8)) & 0x100F00F00F00F00FULL;
+	Result = (Result | (Result << 4)) & 0x10C30C30C30C30C3ULL;
+	Result = (Result | (Result << 2)) & 0x1249249249249249ULL;
+	return(Result);
+}
+
+inline u64
+MortonIndex3(u32 X, u32 Y, u32 Z)
+{
+	u64 Result = SpreadBits3(X) | (SpreadBits3(Y) << 1) | (SpreadBits3(Z) << 2);
+	return(Result);
+}
+
+// NOTE(hugo): Distance along the Hilbert curve filling a Size x Size
+// grid, Size being a power of two.
+internal u64
+HilbertIndex(u32 Size, u32 X, u32 Y)
+{
+	u64 Result = 0;
+	for(u32 S = Size / 2; S > 0; S /= 2)
+	{
+		u32 RX = (X & S) ? 1 : 0;
+		u32 RY = (Y & S) ? 1 : 0;
+		Result += u64(S) * u64(S) * u64((3 * RX) ^ RY);
+		if(RY == 0)
+		{
+			if(RX == 1)
+			{
+				X = S - 1 - X;
+				Y = S - 1 - Y;
+			}
+			u32 Temp = X;
+			X = Y;
+			Y = Temp;
+		}
+	}
+	return(Result);
+}
+
+internal int
+CompareTileSortEntries(const void* A, const void* B)
+{
+	u64 KeyA = ((tile_sort_entry *)A)->Key;
+	u64 KeyB = ((tile_sort_entry *)B)->Key;
+	int Result = (KeyA < KeyB) ? -1 : ((KeyA > KeyB) ? 1 : 0);
+	return(Result);
+}
+
+internal void
+ComputeTileOrder(tile_sort_entry* Entries, u32 XChunkCount, u32 YChunkCount, tile_order Order)
+{
+	u32 CurveSize = 1;
+	while(CurveSize < XChunkCount || CurveSize < YChunkCount)
+	{
+		CurveSize *= 2;
+	}
+
+	for(u32 YChunk = 0; YChunk < YChunkCount; ++YChunk)
+	{
+		for(u32 XChunk = 0; XChunk < XChunkCount; ++XChunk)
+		{
+			tile_sort_entry* Entry = Entries + XChunk + YChunk * XChunkCount;
+			Entry->XChunk = XChunk;
+			Entry->YChunk = YChunk;
+
+			u64 RowIndex = XChunk + u64(YChunk) * XChunkCount;
+			switch(Order)
+			{
+				case TileOrder_Row:
+					{
+						Entry->Key = RowIndex;
+					} break;
+				case TileOrder_Morton:
+					{
+						Entry->Key = MortonIndex(XChunk, YChunk);
+					} break;
+				case TileOrder_Hilbert:
+					{
+						Entry->Key = HilbertIndex(CurveSize, XChunk, YChunk);
+					} break;
+				case TileOrder_CentreOut:
+					{
+						// NOTE(hugo): Twice the distance to the centre, to stay in integers.
+						s64 DX = 2 * s64(XChunk) + 1 - s64(XChunkCount);
+						s64 DY = 2 * s64(YChunk) + 1 - s64(YChunkCount);
+						u64 DistanceSqr = u64(DX * DX + DY * DY);
+						Entry->Key = (DistanceSqr << 32) | RowIndex;
+					} break;
+				InvalidDefaultCase;
+			}
+		}
+	}
+
+	qsort(Entries, XChunkCount * YChunkCount, sizeof(tile_sort_entry), CompareTileSortEntries);
+}
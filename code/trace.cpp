@@ -0,0 +1,165 @@
+#pragma once
+
+// NOTE(hugo): Timeline of the work queue. Every task run by a thread
+// is recorded with its start and end time, whether it was stolen,
+// and what the task says about itself (TraceTask : a name, an id like
+// the tile index, the rays it traced). Each thread writes into its
+// own ring buffer, so only the last TRACE_EVENTS_PER_THREAD tasks of
+// a thread are kept, and nothing is shared while recording.
+//
+// At the end of the run the events are written as Chrome trace_event
+// JSON, to be opened in chrome://tracing or ui.perfetto.dev : gaps
+// in a thread row are the time it spent idle or looking for work.
+
+#define TRACE_EVENTS_PER_THREAD (1 << 16)
+
+struct task_trace_event
+{
+	u64 Start;
+	u64 End;
+	char* Name;
+	// NOTE(hugo): Whatever tells the task apart from the others of its
+	// kind : the tile index, or the first pixel or item of a range.
+	u32 ID;
+	u32 RayCount;
+	bool Stolen;
+};
+
+struct thread_trace_buffer
+{
+	task_trace_event* Events;
+	// NOTE(hugo): Every event ever written, the ring keeps the last ones.
+	u64 EventCount;
+
+	u8 Pad[64 - sizeof(task_trace_event*) - sizeof(u64)];
+};
+
+struct trace_state
+{
+	u32 ThreadCount;
+	// NOTE(hugo): Null when tracing is off.
+	thread_trace_buffer* Buffers;
+	u64 StartCounter;
+};
+
+global_variable trace_state GlobalTrace = {};
+// NOTE(hugo): The event of the task the thread is running, for TraceTask.
+global_variable thread_local task_trace_event* GlobalThreadTraceEvent = 0;
+
+// NOTE(hugo): ThreadCount counts the main thread.
+internal void
+InitialiseTrace(memory_arena* Arena, u32 ThreadCount)
+{
+	GlobalTrace.ThreadCount = ThreadCount;
+	GlobalTrace.Buffers = PushArray(Arena, ThreadCount, thread_trace_buffer, Align(64, true));
+	for(u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ++ThreadIndex)
+	{
+		thread_trace_buffer* Buffer = GlobalTrace.Buffers + ThreadIndex;
+		Buffer->Events = PushArray(Arena, TRACE_EVENTS_PER_THREAD, task_trace_event, Align(64, false));
+		Buffer->EventCount = 0;
+	}
+	GlobalTrace.StartCounter = SDL_GetPerformanceCounter();
+}
+
+// NOTE(hugo): Called by a task to describe itself in the trace.
+inline void
+TraceTask(char* Name, u32 ID, u32 RayCount)
+{
+	task_trace_event* Event = GlobalThreadTraceEvent;
+	if(Event)
+	{
+		Event->Name = Name;
+		Event->ID = ID;
+		Event->RayCount = RayCount;
+	}
+}
+
+// NOTE(hugo): Tasks nest when a task waits on a group (it runs other
+// tasks meanwhile), so the event lives on the stack of the caller and
+// is only copied to the ring once the task is over. Returns the event
+// of the outer task, to give back to EndTaskTrace.
+inline task_trace_event*
+BeginTaskTrace(task_trace_event* Event, bool Stolen)
+{
+	task_trace_event* Outer = GlobalThreadTraceEvent;
+	if(GlobalTrace.Buffers)
+	{
+		Event->Name = "task";
+		Event->Stolen = Stolen;
+		GlobalThreadTraceEvent = Event;
+		Event->Start = SDL_GetPerformanceCounter();
+	}
+	return(Outer);
+}
+
+inline void
+EndTaskTrace(u32 ThreadIndex, task_trace_event* Event, task_trace_event* Outer)
+{
+	if(GlobalTrace.Buffers)
+	{
+		Event->End = SDL_GetPerformanceCounter();
+		Assert(ThreadIndex < GlobalTrace.ThreadCount);
+		thread_trace_buffer* Buffer = GlobalTrace.Buffers + ThreadIndex;
+		Buffer->Events[Buffer->EventCount % TRACE_EVENTS_PER_THREAD] = *Event;
+		++Buffer->EventCount;
+		GlobalThreadTraceEvent = Outer;
+	}
+}
+
+// NOTE(hugo): Must be called while no task runs.
+internal bool
+WriteChromeTrace(char* Filename)
+{
+	FILE* TraceFile = fopen(Filename, "w");
+	if(!TraceFile)
+	{
+		printf("Could not open %s to write the trace.\n", Filename);
+		return(false);
+	}
+
+	double MicrosecondsPerTick = 1000000.0 / double(SDL_GetPerformanceFrequency());
+	u64 WrittenCount = 0;
+	u64 DroppedCount = 0;
+	fprintf(TraceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for(u32 ThreadIndex = 0; ThreadIndex < GlobalTrace.ThreadCount; ++ThreadIndex)
+	{
+		if(ThreadIndex == 0)
+		{
+			fprintf(TraceFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"main\"}}");
+		}
+		else
+		{
+			fprintf(TraceFile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}",
+					ThreadIndex, ThreadIndex);
+		}
+
+		thread_trace_buffer* Buffer = GlobalTrace.Buffers + ThreadIndex;
+		u64 FirstEvent = 0;
+		if(Buffer->EventCount > TRACE_EVENTS_PER_THREAD)
+		{
+			FirstEvent = Buffer->EventCount - TRACE_EVENTS_PER_THREAD;
+			DroppedCount += FirstEvent;
+		}
+		for(u64 EventIndex = FirstEvent; EventIndex < Buffer->EventCount; ++EventIndex)
+		{
+			task_trace_event* Event = Buffer->Events + (EventIndex % TRACE_EVENTS_PER_THREAD);
+			double Start = double(Event->Start - GlobalTrace.StartCounter) * MicrosecondsPerTick;
+			double Duration = double(Event->End - Event->Start) * MicrosecondsPerTick;
+			fprintf(TraceFile, ",\n{\"name\":\"%s\",\"cat\":\"task\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+					"\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"id\":%u,\"rays\":%u,\"stolen\":%s}}",
+					Event->Name, ThreadIndex, Start, Duration, Event->ID, Event->RayCount,
+					Event->Stolen ? "true" : "false");
+			++WrittenCount;
+		}
+	}
+	fprintf(TraceFile, "\n]}\n");
+	fclose(TraceFile);
+
+	printf("Wrote %llu task events to %s", (unsigned long long)WrittenCount, Filename);
+	if(DroppedCount > 0)
+	{
+		printf(" (%llu older ones dropped)", (unsigned long long)DroppedCount);
+	}
+	printf("\n");
+	return(true);
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+// NOTE(hugo): Counters of the work done by the tree traversal, to see
+// why some pixels are slow. They only exist when RAY_TRAVERSAL_STATS
+// is set, otherwise every counter compiles to nothing.
+//
+// The counters are incremented in a thread local set of stats. Their
+// difference around some work (a pixel, a tile, a kernel) is what
+// that work did. Per pixel stats are gathered by the path integrator
+// without packets; packets and the wavefront kernels still add to the
+// pass totals. Counts are per ray : a packet test of 4 rays counts 4.
+
+struct traversal_stats
+{
+	// NOTE(hugo): Nodes whose box was hit, so whose children and
+	// triangles were looked at.
+	u64 NodesVisited;
+	u64 BoxesTested;
+	u64 TrianglesTested;
+	// NOTE(hugo): Triangle hits closer than the closest one so far.
+	u64 Hits;
+};
+
+#define TRAVERSAL_COUNTER_COUNT 4
+global_variable char* TraversalCounterNames[TRAVERSAL_COUNTER_COUNT] =
+{
+	"nodes", "boxes", "triangles", "hits",
+};
+
+#if RAY_TRAVERSAL_STATS
+global_variable thread_local traversal_stats GlobalThreadTraversalStats = {};
+#define TRAVERSAL_STAT(Counter) ++GlobalThreadTraversalStats.Counter
+#define TRAVERSAL_STAT_ADD(Counter, Value) GlobalThreadTraversalStats.Counter += (Value)
+#else
+#define TRAVERSAL_STAT(Counter)
+#define TRAVERSAL_STAT_ADD(Counter, Value)
+#endif
+
+inline u64*
+GetTraversalCounter(traversal_stats* Stats, u32 CounterIndex)
+{
+	Assert(CounterIndex < TRAVERSAL_COUNTER_COUNT);
+	u64* Result = &Stats->NodesVisited + CounterIndex;
+	return(Result);
+}
+
+inline void
+AddTraversalStats(traversal_stats* Dest, traversal_stats A)
+{
+	for(u32 CounterIndex = 0; CounterIndex < TRAVERSAL_COUNTER_COUNT; ++CounterIndex)
+	{
+		*GetTraversalCounter(Dest, CounterIndex) += *GetTraversalCounter(&A, CounterIndex);
+	}
+}
+
+inline traversal_stats
+SubtractTraversalStats(traversal_stats A, traversal_stats B)
+{
+	traversal_stats Result = A;
+	for(u32 CounterIndex = 0; CounterIndex < TRAVERSAL_COUNTER_COUNT; ++CounterIndex)
+	{
+		*GetTraversalCounter(&Result, CounterIndex) -= *GetTraversalCounter(&B, CounterIndex);
+	}
+	return(Result);
+}
+
+internal void
+PrintTraversalStats(traversal_stats Stats, u64 RayCount)
+{
+	double Rays = (RayCount > 0) ? double(RayCount) : 1.0;
+	printf("\tTraversal : %.1f nodes, %.1f boxes, %.1f triangles, %.2f hits per ray.\n",
+			double(Stats.NodesVisited) / Rays, double(Stats.BoxesTested) / Rays,
+			double(Stats.TrianglesTested) / Rays, double(Stats.Hits) / Rays);
+}
+
+// NOTE(hugo): Blue (cheap) to red (expensive), T in [0, 1].
+internal u32
+HeatmapColor(float T)
+{
+	v3 Stops[] =
+	{
+		V3(0.0f, 0.0f, 0.5f),
+		V3(0.0f, 0.5f, 1.0f),
+		V3(0.0f, 0.9f, 0.3f),
+		V3(1.0f, 0.9f, 0.0f),
+		V3(1.0f, 0.0f, 0.0f),
+	};
+	float Position = Clamp01(T) * float(ArrayCount(Stops) - 1);
+	u32 StopIndex = Minu(u32(Position), ArrayCount(Stops) - 2);
+	v3 Color = Lerp(Stops[StopIndex], Position - float(StopIndex), Stops[StopIndex + 1]);
+	return(RGBToPixel(Clamp01(Color)));
+}
+
+#define TRAVERSAL_HISTOGRAM_BIN_COUNT 16
+#define TRAVERSAL_PERCENTILE_BIN_COUNT 1024
+
+// NOTE(hugo): Writes one false colour image per counter, of its
+// mean per sample in each pixel, and prints its histogram. The
+// colours are scaled to the 99th percentile so that a handful of
+// very slow pixels do not flatten the rest of the image.
+internal void
+WriteTraversalHeatmaps(char* OutputPath, traversal_stats* PixelStats,
+		u32 Width, u32 Height, u32 SampleCount, memory_arena* Arena)
+{
+	u32 PixelCount = Width * Height;
+	temporary_memory TempMemory = BeginTemporaryMemory(Arena);
+	float* Values = PushArray(Arena, PixelCount, float, Align(64, false));
+	u32* Pixels = PushArray(Arena, PixelCount, u32, Align(64, false));
+	u32* PercentileBins = PushArray(Arena, TRAVERSAL_PERCENTILE_BIN_COUNT, u32);
+
+	for(u32 CounterIndex = 0; CounterIndex < TRAVERSAL_COUNTER_COUNT; ++CounterIndex)
+	{
+		float MaxValue = 0.0f;
+		double Sum = 0.0;
+		for(u32 PixelIndex = 0; PixelIndex < PixelCount; ++PixelIndex)
+		{
+			float Value = float(*GetTraversalCounter(PixelStats + PixelIndex, CounterIndex)) / float(Maxu(1, SampleCount));
+			Values[PixelIndex] = Value;
+			MaxValue = Maxf(MaxValue, Value);
+			Sum += Value;
+		}
+
+		for(u32 BinIndex = 0; BinIndex < TRAVERSAL_PERCENTILE_BIN_COUNT; ++BinIndex)
+		{
+			PercentileBins[BinIndex] = 0;
+		}
+		float BinScale = (MaxValue > 0.0f) ? float(TRAVERSAL_PERCENTILE_BIN_COUNT - 1) / MaxValue : 0.0f;
+		for(u32 PixelIndex = 0; PixelIndex < PixelCount; ++PixelIndex)
+		{
+			++PercentileBins[u32(BinScale * Values[PixelIndex])];
+		}
+		u32 Below = 0;
+		u32 PercentileBin = 0;
+		while(PercentileBin < TRAVERSAL_PERCENTILE_BIN_COUNT - 1 && 100 * (Below + PercentileBins[PercentileBin]) < 99 * PixelCount)
+		{
+			Below += PercentileBins[PercentileBin];
+			++PercentileBin;
+		}
+		float Percentile99 = (BinScale > 0.0f) ? float(PercentileBin + 1) / BinScale : 1.0f;
+
+		for(u32 PixelIndex = 0; PixelIndex < PixelCount; ++PixelIndex)
+		{
+			Pixels[PixelIndex] = HeatmapColor(Values[PixelIndex] / Percentile99);
+		}
+		char Filename[CONFIG_PATH_SIZE + 32];
+		snprintf(Filename, sizeof(Filename), "%s_%s.ppm", OutputPath, TraversalCounterNames[CounterIndex]);
+		WritePPM(Filename, Width, Height, Pixels);
+
+		printf("Traversal %s per sample : mean %.2f, 99th percentile %.2f, max %.2f (%s)\n",
+				TraversalCounterNames[CounterIndex], Sum / double(PixelCount), Percentile99, MaxValue, Filename);
+		u32 Histogram[TRAVERSAL_HISTOGRAM_BIN_COUNT] = {};
+		float HistogramScale = (MaxValue > 0.0f) ? float(TRAVERSAL_HISTOGRAM_BIN_COUNT) / MaxValue : 0.0f;
+		u32 LargestBin = 1;
+		for(u32 PixelIndex = 0; PixelIndex < PixelCount; ++PixelIndex)
+		{
+			u32 BinIndex = Minu(u32(HistogramScale * Values[PixelIndex]), TRAVERSAL_HISTOGRAM_BIN_COUNT - 1);
+			++Histogram[BinIndex];
+			LargestBin = Maxu(LargestBin, Histogram[BinIndex]);
+		}
+		for(u32 BinIndex = 0; BinIndex < TRAVERSAL_HISTOGRAM_BIN_COUNT; ++BinIndex)
+		{
+			char Bar[41] = {};
+			u32 BarLength = u32(40.0f * float(Histogram[BinIndex]) / float(LargestBin));
+			memset(Bar, '#', BarLength);
+			printf("\t%8.2f - %8.2f %8u %s\n",
+					float(BinIndex) * MaxValue / float(TRAVERSAL_HISTOGRAM_BIN_COUNT),
+					float(BinIndex + 1) * MaxValue / float(TRAVERSAL_HISTOGRAM_BIN_COUNT),
+					Histogram[BinIndex], Bar);
+		}
+	}
+
+	EndTemporaryMemory(TempMemory);
+}
@@ -0,0 +1,616 @@
+#pragma once
+
+// NOTE(hugo): Wavefront integrator. Instead of following one path at a
+// time through ShootRay, a batch of paths moves through separate
+// stages, each being a parallel kernel on the work queue :
+//
+//   generate   : one camera ray per path of the batch
+//   intersect  : closest hit of every active ray in the kd-tree
+//   shade      : material evaluation, Russian roulette and next ray.
+//                Paths that end write their radiance, the others
+//                write their next ray in the scratch queue
+//   compact    : gathers the surviving paths back into the active queue
+//   sort       : optionally reorders them by origin cell and direction
+//                octant so that consecutive rays visit the same nodes
+//   accumulate : sums the radiance of the samples of each pixel
+//
+// The estimator is the same as ShootRay : a path carries the product
+// of the colors of the surfaces it bounced on, and ends on a light,
+// on the background or when killed by the roulette.
+// There is no shadow stage since the integrator does no light sampling.
+//
+// Every path has its own random series seeded from its index so the
+// image does not depend on how the kernels were split.
+
+struct soa_v3
+{
+	float* X;
+	float* Y;
+	float* Z;
+};
+
+inline v3
+GetV3(soa_v3 Array, u32 Index)
+{
+	v3 Result = V3(Array.X[Index], Array.Y[Index], Array.Z[Index]);
+	return(Result);
+}
+
+inline void
+SetV3(soa_v3 Array, u32 Index, v3 Value)
+{
+	Array.X[Index] = Value.x;
+	Array.Y[Index] = Value.y;
+	Array.Z[Index] = Value.z;
+}
+
+internal soa_v3
+PushSOAV3(memory_arena* Arena, u32 Count)
+{
+	soa_v3 Result = {};
+	Result.X = PushArray(Arena, Count, float, Align(64, false));
+	Result.Y = PushArray(Arena, Count, float, Align(64, false));
+	Result.Z = PushArray(Arena, Count, float, Align(64, false));
+	return(Result);
+}
+
+struct path_queue
+{
+	soa_v3 Origin;
+	soa_v3 Dir;
+	// NOTE(hugo): Product of the surface colors met so far.
+	soa_v3 Weight;
+	// NOTE(hugo): Russian roulette state, as ray_context::Throughput.
+	soa_v3 Throughput;
+	u32* Depth;
+	// NOTE(hugo): Index of the path in the batch, where its radiance goes.
+	u32* Slot;
+	u64* RandomAlpha;
+	u64* RandomBeta;
+};
+
+internal void
+PushPathQueue(memory_arena* Arena, path_queue* Queue, u32 Count)
+{
+	Queue->Origin = PushSOAV3(Arena, Count);
+	Queue->Dir = PushSOAV3(Arena, Count);
+	Queue->Weight = PushSOAV3(Arena, Count);
+	Queue->Throughput = PushSOAV3(Arena, Count);
+	Queue->Depth = PushArray(Arena, Count, u32, Align(64, false));
+	Queue->Slot = PushArray(Arena, Count, u32, Align(64, false));
+	Queue->RandomAlpha = PushArray(Arena, Count, u64, Align(64, false));
+	Queue->RandomBeta = PushArray(Arena, Count, u64, Align(64, false));
+}
+
+inline void
+CopyPath(path_queue* Dest, u32 DestIndex, path_queue* Source, u32 SourceIndex)
+{
+	SetV3(Dest->Origin, DestIndex, GetV3(Source->Origin, SourceIndex));
+	SetV3(Dest->Dir, DestIndex, GetV3(Source->Dir, SourceIndex));
+	SetV3(Dest->Weight, DestIndex, GetV3(Source->Weight, SourceIndex));
+	SetV3(Dest->Throughput, DestIndex, GetV3(Source->Throughput, SourceIndex));
+	Dest->Depth[DestIndex] = Source->Depth[SourceIndex];
+	Dest->Slot[DestIndex] = Source->Slot[SourceIndex];
+	Dest->RandomAlpha[DestIndex] = Source->RandomAlpha[SourceIndex];
+	Dest->RandomBeta[DestIndex] = Source->RandomBeta[SourceIndex];
+}
+
+struct wavefront_state;
+struct wavefront_kernel_task
+{
+	wavefront_state* Wavefront;
+	platform_work_queue_callback* Kernel;
+	u32 First;
+	u32 OnePastLast;
+	// NOTE(hugo): Written by the shade kernel, read by the compaction.
+	u32 SurvivorCount;
+	u32 SurvivorOffset;
+	u32 RayCount;
+	u64 Cycles;
+#if RAY_TRAVERSAL_STATS
+	traversal_stats TraversalStats;
+#endif
+};
+
+// NOTE(hugo): Less items than that per task is not worth the scheduling.
+#define WAVEFRONT_MIN_ITEMS_PER_TASK 512
+
+struct wavefront_state
+{
+	render_state* RenderState;
+	u32 BatchSize;
+
+	// NOTE(hugo): Active holds the compacted paths being traced,
+	// Scratch receives the output of the shade kernel.
+	path_queue Active;
+	path_queue Scratch;
+	u32 ActiveCount;
+	u8* Alive;
+
+	float* HitT;
+	soa_v3 HitN;
+	u32* HitMaterial;
+
+	soa_v3 Radiance;
+
+	// NOTE(hugo): Current batch : paths [BatchFirstPath, BatchFirstPath + BatchPathCount)
+	// of the pass, path P being sample P % SamplesPerTask of pixel P / SamplesPerTask.
+	u32 BatchFirstPath;
+	u32 BatchPathCount;
+	u64 PassSeed;
+	v3* Target;
+
+	// NOTE(hugo): Sort entries are (key << 32) | path index.
+	bool SortRays;
+	rect3 SceneBounds;
+	u64* SortEntries;
+	u64* SortTemp;
+
+	u32 MaxTaskCount;
+	u32 TaskCount;
+	wavefront_kernel_task* Tasks;
+
+	// NOTE(hugo): Statistics of the last pass.
+	u32 RayCount;
+	u64 BusyCycles;
+#if RAY_TRAVERSAL_STATS
+	traversal_stats TraversalStats;
+#endif
+	// NOTE(hugo): Of the intersect stage for bounced rays only.
+	// The misses stay at 0 without a counter.
+	cache_miss_counter* CacheMissCounter;
+	u64 SecondaryRayCount;
+	u64 SecondaryIntersectCycles;
+	u64 SecondaryCacheMisses;
+};
+
+internal wavefront_state*
+CreateWavefrontState(render_state* RenderState, u32 BatchSize)
+{
+	memory_arena* Arena = &RenderState->Arena;
+	wavefront_state* Wavefront = PushStruct(Arena, wavefront_state, Align(64, true));
+	Wavefront->RenderState = RenderState;
+
+	// NOTE(hugo): A batch always holds whole pixels so the
+	// accumulate kernel can write the pass buffer directly.
+	u32 SamplesPerPixel = RenderState->Config.SamplesPerTask;
+	BatchSize = Maxu(SamplesPerPixel, (BatchSize / SamplesPerPixel) * SamplesPerPixel);
+	Wavefront->BatchSize = BatchSize;
+
+	PushPathQueue(Arena, &Wavefront->Active, BatchSize);
+	PushPathQueue(Arena, &Wavefront->Scratch, BatchSize);
+	Wavefront->Alive = PushArray(Arena, BatchSize, u8, Align(64, false));
+	Wavefront->HitT = PushArray(Arena, BatchSize, float, Align(64, false));
+	Wavefront->HitN = PushSOAV3(Arena, BatchSize);
+	Wavefront->HitMaterial = PushArray(Arena, BatchSize, u32, Align(64, false));
+	Wavefront->Radiance = PushSOAV3(Arena, BatchSize);
+
+	Wavefront->SortRays = RenderState->Config.SortRays;
+	Wavefront->SceneBounds = RenderState->Trees[0].BoundingBox;
+	if(Wavefront->SortRays)
+	{
+		Wavefront->SortEntries = PushArray(Arena, BatchSize, u64, Align(64, false));
+		Wavefront->SortTemp = PushArray(Arena, BatchSize, u64, Align(64, false));
+	}
+
+	Wavefront->MaxTaskCount = 4 * RenderState->Queue.DequeCount;
+	Wavefront->Tasks = PushArray(Arena, Wavefront->MaxTaskCount, wavefront_kernel_task, Align(64, true));
+
+	return(Wavefront);
+}
+
+PLATFORM_WORK_QUEUE_CALLBACK(WavefrontGenerate)
+{
+	wavefront_kernel_task* Task = (wavefront_kernel_task *)Data;
+	wavefront_state* Wavefront = Task->Wavefront;
+	render_state* RenderState = Wavefront->RenderState;
+	path_queue* Paths = &Wavefront->Active;
+	u32 SamplesPerPixel = RenderState->Config.SamplesPerTask;
+	u32 Width = RenderState->Config.Width;
+	TIMED_BLOCK_COUNTED(Generate, Task->OnePastLast - Task->First);
+
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		u32 PathIndex = Wavefront->BatchFirstPath + Index;
+		u32 PixelIndex = PathIndex / SamplesPerPixel;
+
+		u64 SeedState = Wavefront->PassSeed ^ (u64(PathIndex) * 0xD1B54A32D192ED03);
+		random_series Entropy = RandomSeed(SplitMix64(&SeedState), SplitMix64(&SeedState));
+		float XOffset = RandomUnilateral(&Entropy);
+		float YOffset = RandomUnilateral(&Entropy);
+		ray Ray = GenerateCameraRay(RenderState, PixelIndex % Width, PixelIndex / Width, XOffset, YOffset);
+
+		SetV3(Paths->Origin, Index, Ray.Start);
+		SetV3(Paths->Dir, Index, Ray.Dir);
+		SetV3(Paths->Weight, Index, V3(1.0f, 1.0f, 1.0f));
+		SetV3(Paths->Throughput, Index, V3(1.0f, 1.0f, 1.0f));
+		Paths->Depth[Index] = 0;
+		Paths->Slot[Index] = Index;
+		Paths->RandomAlpha[Index] = Entropy.Alpha;
+		Paths->RandomBeta[Index] = Entropy.Beta;
+	}
+}
+
+PLATFORM_WORK_QUEUE_CALLBACK(WavefrontIntersect)
+{
+	wavefront_kernel_task* Task = (wavefront_kernel_task *)Data;
+	wavefront_state* Wavefront = Task->Wavefront;
+	render_state* RenderState = Wavefront->RenderState;
+	path_queue* Paths = &Wavefront->Active;
+	TIMED_BLOCK_COUNTED(Traverse, Task->OnePastLast - Task->First);
+
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		ray Ray = {};
+		Ray.Start = GetV3(Paths->Origin, Index);
+		Ray.Dir = GetV3(Paths->Dir, Index);
+
+		hit_record ClosestHitRecord = {};
+		ClosestHitRecord.t = MAX_FLOAT32;
+		RayKdTreeIntersection(Ray, &RenderState->Trees[0], RenderState, &ClosestHitRecord);
+
+		Wavefront->HitT[Index] = ClosestHitRecord.t;
+		SetV3(Wavefront->HitN, Index, ClosestHitRecord.N);
+		Wavefront->HitMaterial[Index] = ClosestHitRecord.MaterialIndex;
+	}
+	Task->RayCount = Task->OnePastLast - Task->First;
+}
+
+PLATFORM_WORK_QUEUE_CALLBACK(WavefrontShade)
+{
+	wavefront_kernel_task* Task = (wavefront_kernel_task *)Data;
+	wavefront_state* Wavefront = Task->Wavefront;
+	render_state* RenderState = Wavefront->RenderState;
+	path_queue* Paths = &Wavefront->Active;
+	path_queue* Next = &Wavefront->Scratch;
+	TIMED_BLOCK_COUNTED(Shade, Task->OnePastLast - Task->First);
+
+	u32 SurvivorCount = 0;
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		random_series Entropy = RandomSeed(Paths->RandomAlpha[Index], Paths->RandomBeta[Index]);
+		v3 Dir = GetV3(Paths->Dir, Index);
+		v3 Weight = GetV3(Paths->Weight, Index);
+		u32 Slot = Paths->Slot[Index];
+		float t = Wavefront->HitT[Index];
+
+		bool Alive = false;
+		if(t < MAX_FLOAT32)
+		{
+			v3 HitP = GetV3(Paths->Origin, Index) + t * Dir;
+			v3 HitN = GetV3(Wavefront->HitN, Index);
+			v3 TargetDiffuse = HitN + GetRandomPointInUnitSphere(&Entropy);
+			v3 TargetSpecular = Reflect(Dir, HitN);
+			material* M = RenderState->Materials + Wavefront->HitMaterial[Index];
+
+			if(M->IsLight)
+			{
+				SetV3(Wavefront->Radiance, Slot, Hadamard(Weight, M->Emissivity));
+			}
+			else
+			{
+				v3 RayColor = M->Attenuation * M->Albedo;
+				u32 Depth = Paths->Depth[Index];
+
+				// NOTE(hugo): Russian Roulette Path Termination
+				v3 Throughput = Hadamard(GetV3(Paths->Throughput, Index), RayColor);
+				float RussianRouletteP = Maxf(Throughput.x, Maxf(Throughput.y, Throughput.z));
+				if(Depth > 0 && RandomUnilateral(&Entropy) > RussianRouletteP)
+				{
+					SetV3(Wavefront->Radiance, Slot, Hadamard(Weight, RayColor));
+				}
+				else
+				{
+					Throughput *= 1.0f / RussianRouletteP;
+
+					SetV3(Next->Origin, Index, HitP);
+					SetV3(Next->Dir, Index, NormalizedFast(Lerp(TargetSpecular, M->Scatter, TargetDiffuse)));
+					SetV3(Next->Weight, Index, Hadamard(Weight, RayColor));
+					SetV3(Next->Throughput, Index, Throughput);
+					Next->Depth[Index] = Depth + 1;
+					Next->Slot[Index] = Slot;
+					Next->RandomAlpha[Index] = Entropy.Alpha;
+					Next->RandomBeta[Index] = Entropy.Beta;
+					Alive = true;
+					++SurvivorCount;
+				}
+			}
+		}
+		else
+		{
+			// NOTE(hugo): No hit : Background color
+			SetV3(Wavefront->Radiance, Slot, Hadamard(Weight, BackgroundColor(Dir)));
+		}
+		Wavefront->Alive[Index] = Alive ? 1 : 0;
+	}
+	Task->SurvivorCount = SurvivorCount;
+}
+
+// NOTE(hugo): Runs with the same split as the shade kernel
+// that produced the survivors.
+PLATFORM_WORK_QUEUE_CALLBACK(WavefrontCompact)
+{
+	wavefront_kernel_task* Task = (wavefront_kernel_task *)Data;
+	wavefront_state* Wavefront = Task->Wavefront;
+
+	u32 DestIndex = Task->SurvivorOffset;
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		if(Wavefront->Alive[Index])
+		{
+			CopyPath(&Wavefront->Active, DestIndex, &Wavefront->Scratch, Index);
+			++DestIndex;
+		}
+	}
+	Assert(DestIndex == Task->SurvivorOffset + Task->SurvivorCount);
+}
+
+// NOTE(hugo): The key is the direction octant on top of the
+// Morton index of the origin in a 512^3 grid over the scene.
+PLATFORM_WORK_QUEUE_CALLBACK(WavefrontSortKeys)
+{
+	wavefront_kernel_task* Task = (wavefront_kernel_task *)Data;
+	wavefront_state* Wavefront = Task->Wavefront;
+	path_queue* Paths = &Wavefront->Active;
+	rect3 Bounds = Wavefront->SceneBounds;
+	v3 Size = RectSize(Bounds);
+	v3 CellScale = V3(Size.x > 0.0f ? 511.0f / Size.x : 0.0f,
+			Size.y > 0.0f ? 511.0f / Size.y : 0.0f,
+			Size.z > 0.0f ? 511.0f / Size.z : 0.0f);
+
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		v3 Origin = GetV3(Paths->Origin, Index);
+		v3 Dir = GetV3(Paths->Dir, Index);
+		u32 CellX = u32(Clamp(CellScale.x * (Origin.x - Bounds.Min.x), 0.0f, 511.0f));
+		u32 CellY = u32(Clamp(CellScale.y * (Origin.y - Bounds.Min.y), 0.0f, 511.0f));
+		u32 CellZ = u32(Clamp(CellScale.z * (Origin.z - Bounds.Min.z), 0.0f, 511.0f));
+		u32 Octant = ((Dir.x < 0.0f) ? 1 : 0) | ((Dir.y < 0.0f) ? 2 : 0) | ((Dir.z < 0.0f) ? 4 : 0);
+		u32 Key = (Octant << 27) | u32(MortonIndex3(CellX, CellY, CellZ));
+		Wavefront->SortEntries[Index] = (u64(Key) << 32) | Index;
+	}
+}
+
+PLATFORM_WORK_QUEUE_CALLBACK(WavefrontGather)
+{
+	wavefront_kernel_task* Task = (wavefront_kernel_task *)Data;
+	wavefront_state* Wavefront = Task->Wavefront;
+
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		u32 SourceIndex = u32(Wavefront->SortEntries[Index] & 0xFFFFFFFF);
+		CopyPath(&Wavefront->Scratch, Index, &Wavefront->Active, SourceIndex);
+	}
+}
+
+// NOTE(hugo): LSD radix sort of the entries on their high 32 bits,
+// 8 bits per pass. The sort is stable so equal keys keep the
+// compaction order.
+internal void
+RadixSortHighWord(u64* Entries, u64* Temp, u32 Count)
+{
+	u64* Source = Entries;
+	u64* Dest = Temp;
+	for(u32 Shift = 32; Shift < 64; Shift += 8)
+	{
+		u32 Offsets[256] = {};
+		for(u32 Index = 0; Index < Count; ++Index)
+		{
+			++Offsets[(Source[Index] >> Shift) & 0xFF];
+		}
+		u32 Total = 0;
+		for(u32 Bucket = 0; Bucket < 256; ++Bucket)
+		{
+			u32 BucketCount = Offsets[Bucket];
+			Offsets[Bucket] = Total;
+			Total += BucketCount;
+		}
+		for(u32 Index = 0; Index < Count; ++Index)
+		{
+			Dest[Offsets[(Source[Index] >> Shift) & 0xFF]++] = Source[Index];
+		}
+
+		u64* Swap = Source;
+		Source = Dest;
+		Dest = Swap;
+	}
+	// NOTE(hugo): An even number of passes, the result is back in Entries.
+	Assert(Source == Entries);
+}
+
+PLATFORM_WORK_QUEUE_CALLBACK(WavefrontAccumulate)
+{
+	wavefront_kernel_task* Task = (wavefront_kernel_task *)Data;
+	wavefront_state* Wavefront = Task->Wavefront;
+	u32 SamplesPerPixel = Wavefront->RenderState->Config.SamplesPerTask;
+	u32 FirstPixel = Wavefront->BatchFirstPath / SamplesPerPixel;
+
+	// NOTE(hugo): Here the items are the pixels of the batch.
+	for(u32 Index = Task->First; Index < Task->OnePastLast; ++Index)
+	{
+		v3 SampleSum = {};
+		for(u32 SampleIndex = 0; SampleIndex < SamplesPerPixel; ++SampleIndex)
+		{
+			SampleSum += GetV3(Wavefront->Radiance, Index * SamplesPerPixel + SampleIndex);
+		}
+		Wavefront->Target[FirstPixel + Index] = SampleSum;
+	}
+}
+
+internal char*
+WavefrontKernelName(platform_work_queue_callback* Kernel)
+{
+	char* Result = "kernel";
+	if(Kernel == WavefrontGenerate)
+	{
+		Result = "generate";
+	}
+	else if(Kernel == WavefrontIntersect)
+	{
+		Result = "intersect";
+	}
+	else if(Kernel == WavefrontShade)
+	{
+		Result = "shade";
+	}
+	else if(Kernel == WavefrontCompact)
+	{
+		Result = "compact";
+	}
+	else if(Kernel == WavefrontSortKeys)
+	{
+		Result = "sort keys";
+	}
+	else if(Kernel == WavefrontGather)
+	{
+		Result = "gather";
+	}
+	else if(Kernel == WavefrontAccumulate)
+	{
+		Result = "accumulate";
+	}
+	return(Result);
+}
+
+PLATFORM_WORK_QUEUE_CALLBACK(WavefrontKernelTask)
+{
+	wavefront_kernel_task* Task = (wavefront_kernel_task *)Data;
+	u64 StartCycles = SDL_GetPerformanceCounter();
+#if RAY_TRAVERSAL_STATS
+	traversal_stats StartStats = GlobalThreadTraversalStats;
+#endif
+	Task->Kernel(Queue, Task);
+	Task->Cycles = SDL_GetPerformanceCounter() - StartCycles;
+	TraceTask(WavefrontKernelName(Task->Kernel), Task->First, Task->RayCount);
+#if RAY_TRAVERSAL_STATS
+	Task->TraversalStats = SubtractTraversalStats(GlobalThreadTraversalStats, StartStats);
+#endif
+}
+
+// NOTE(hugo): Splits [0, ItemCount) in contiguous ranges, runs the
+// kernel over them on the work queue and waits for all of them.
+// The split only depends on ItemCount.
+internal void
+RunWavefrontKernel(wavefront_state* Wavefront, platform_work_queue_callback* Kernel,
+		u32 ItemCount, bool KeepSplit = false)
+{
+	platform_work_queue* Queue = &Wavefront->RenderState->Queue;
+	if(!KeepSplit)
+	{
+		u32 TaskCount = (ItemCount + WAVEFRONT_MIN_ITEMS_PER_TASK - 1) / WAVEFRONT_MIN_ITEMS_PER_TASK;
+		TaskCount = Maxu(1, Minu(TaskCount, Wavefront->MaxTaskCount));
+		u32 ItemsPerTask = (ItemCount + TaskCount - 1) / TaskCount;
+		Wavefront->TaskCount = TaskCount;
+		for(u32 TaskIndex = 0; TaskIndex < TaskCount; ++TaskIndex)
+		{
+			wavefront_kernel_task* Task = Wavefront->Tasks + TaskIndex;
+			Task->Wavefront = Wavefront;
+			Task->First = Minu(ItemCount, TaskIndex * ItemsPerTask);
+			Task->OnePastLast = Minu(ItemCount, Task->First + ItemsPerTask);
+		}
+	}
+
+	platform_task_group Group = {};
+	for(u32 TaskIndex = 0; TaskIndex < Wavefront->TaskCount; ++TaskIndex)
+	{
+		wavefront_kernel_task* Task = Wavefront->Tasks + TaskIndex;
+		Task->Kernel = Kernel;
+		Task->RayCount = 0;
+		SDLAddEntry(Queue, &Group, WavefrontKernelTask, Task);
+	}
+	SDLWaitForTaskGroup(Queue, &Group);
+
+	for(u32 TaskIndex = 0; TaskIndex < Wavefront->TaskCount; ++TaskIndex)
+	{
+		Wavefront->RayCount += Wavefront->Tasks[TaskIndex].RayCount;
+		Wavefront->BusyCycles += Wavefront->Tasks[TaskIndex].Cycles;
+#if RAY_TRAVERSAL_STATS
+		AddTraversalStats(&Wavefront->TraversalStats, Wavefront->Tasks[TaskIndex].TraversalStats);
+#endif
+	}
+}
+
+internal void
+TraceWavefrontBatch(wavefront_state* Wavefront)
+{
+	RunWavefrontKernel(Wavefront, WavefrontGenerate, Wavefront->BatchPathCount);
+	Wavefront->ActiveCount = Wavefront->BatchPathCount;
+
+	bool Secondary = false;
+	while(Wavefront->ActiveCount > 0)
+	{
+		if(Secondary && Wavefront->SortRays)
+		{
+			RunWavefrontKernel(Wavefront, WavefrontSortKeys, Wavefront->ActiveCount);
+			RadixSortHighWord(Wavefront->SortEntries, Wavefront->SortTemp, Wavefront->ActiveCount);
+			RunWavefrontKernel(Wavefront, WavefrontGather, Wavefront->ActiveCount);
+
+			path_queue Swap = Wavefront->Active;
+			Wavefront->Active = Wavefront->Scratch;
+			Wavefront->Scratch = Swap;
+		}
+
+		u64 StartMisses = 0;
+		u64 StartCycles = SDL_GetPerformanceCounter();
+		if(Wavefront->CacheMissCounter)
+		{
+			StartMisses = ReadCacheMissCounter(Wavefront->CacheMissCounter);
+		}
+		RunWavefrontKernel(Wavefront, WavefrontIntersect, Wavefront->ActiveCount);
+		if(Secondary)
+		{
+			Wavefront->SecondaryRayCount += Wavefront->ActiveCount;
+			Wavefront->SecondaryIntersectCycles += SDL_GetPerformanceCounter() - StartCycles;
+			if(Wavefront->CacheMissCounter)
+			{
+				Wavefront->SecondaryCacheMisses += ReadCacheMissCounter(Wavefront->CacheMissCounter) - StartMisses;
+			}
+		}
+		Secondary = true;
+
+		RunWavefrontKernel(Wavefront, WavefrontShade, Wavefront->ActiveCount);
+
+		u32 SurvivorCount = 0;
+		for(u32 TaskIndex = 0; TaskIndex < Wavefront->TaskCount; ++TaskIndex)
+		{
+			wavefront_kernel_task* Task = Wavefront->Tasks + TaskIndex;
+			Task->SurvivorOffset = SurvivorCount;
+			SurvivorCount += Task->SurvivorCount;
+		}
+
+		if(SurvivorCount > 0)
+		{
+			RunWavefrontKernel(Wavefront, WavefrontCompact, Wavefront->ActiveCount, true);
+		}
+		Wavefront->ActiveCount = SurvivorCount;
+	}
+
+	RunWavefrontKernel(Wavefront, WavefrontAccumulate,
+			Wavefront->BatchPathCount / Wavefront->RenderState->Config.SamplesPerTask);
+}
+
+// NOTE(hugo): A whole pass as one task : it drives the stages and
+// helps running them while it waits, so the pass can stay in flight
+// while the main thread presents the previous one.
+PLATFORM_WORK_QUEUE_CALLBACK(WavefrontPass)
+{
+	wavefront_state* Wavefront = (wavefront_state *)Data;
+	render_config* Config = &Wavefront->RenderState->Config;
+	u32 PathCount = Config->Width * Config->Height * Config->SamplesPerTask;
+	TraceTask("wavefront pass", 0, 0);
+
+	Wavefront->RayCount = 0;
+	Wavefront->BusyCycles = 0;
+	Wavefront->SecondaryRayCount = 0;
+	Wavefront->SecondaryIntersectCycles = 0;
+	Wavefront->SecondaryCacheMisses = 0;
+#if RAY_TRAVERSAL_STATS
+	Wavefront->TraversalStats = {};
+#endif
+	for(u32 FirstPath = 0; FirstPath < PathCount; FirstPath += Wavefront->BatchSize)
+	{
+		Wavefront->BatchFirstPath = FirstPath;
+		Wavefront->BatchPathCount = Minu(Wavefront->BatchSize, PathCount - FirstPath);
+		TraceWavefrontBatch(Wavefront);
+	}
+}